@@ -0,0 +1,382 @@
+// =====================================================================
+// DURATION AND JITTER BENCHMARK (native, scripted TTL sessions)
+// =====================================================================
+// Runs the real setup()/loop() of src/main.cpp against the HAL fakes
+// (lib/Hal/HalNative.h), latches TTL edges at scripted cycles while
+// loop() runs and times every AD9833 control word on the virtual clock:
+//   onset    - control word that releases RESET, latched by FSYNC
+//   offset   - the next control word that sets RESET again
+// Each tone is matched to the edge that started it. Scenarios:
+//   iti      - --trials edges, ITIs drawn from --iti-ms MIN MAX
+//   double   - pairs of edges 2 us - 1 ms apart (bounce, double pulses);
+//              one due while the trigger ISR runs comes when it returns,
+//              as the latched INT1 flag does
+//   at_end   - a second edge around the end of a tone, -1 ms .. +1 ms
+//   script   - edge times in ms from --script FILE, one per line
+// For each one it reports the on-time against --duration-ms, the edge
+// to onset latency and the inter-onset jitter: onset to onset interval
+// minus edge to edge interval, over consecutive tones whose edges both
+// came while no tone played. An edge held while the previous tone still
+// played is timed from that tone's offset word instead (re-arm time).
+// The report is JSON on stdout; the exit status is 1 when an on-time
+// error, a latency, a re-arm time or the scenario's jitter exceeds its
+// limit, so a timing regression fails the run. The latency limit
+// defaults to the firmware's own onset bound (TriggerPlan).
+//
+// Usage:
+//   duration_jitter [options]
+//     --trials N           edges in the iti scenario (default 20)
+//     --iti-ms MIN MAX     ITI range (default 800 2500)
+//     --seed S             ITI generator seed (default 1)
+//     --script FILE        add a scenario with these edge times (ms)
+//     --duration-ms MS     expected tone duration (default 350)
+//     --max-error-us US    on-time error limit (default 10)
+//     --max-latency-us US  edge to onset limit (default: onset bound)
+//     --max-rearm-us US    offset to onset limit for a held edge
+//                          (default 40: loop() re-arms, then plays it)
+//     --max-jitter-us US   iti inter-onset jitter limit (default 5)
+//     --max-event-jitter-us US
+//                          double / at_end jitter limit (default 10)
+//     --csv FILE           one line per tone
+//
+//   pio run -e timing_bench && .pio/build/timing_bench/program > timing.json
+// =====================================================================
+
+#if defined(HAL_NATIVE) && !defined(PIO_UNIT_TESTING)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "Hal.h"
+#include "TriggerPlan.h"
+
+void setup();
+void loop();
+extern TriggerPlan tonePlan;
+
+#define FSYNC_PIN           2       // AD9833 chip select in main.cpp
+#define LOOP_IDLE_CYCLES    160     // 10 us of other work per loop() pass
+#define SETTLE_MS           1000    // Idle before and after each scenario
+#define RESET_BIT           0x0100
+#define CYCLES_PER_MS       (F_CPU / 1000UL)
+
+struct Tone {
+    uint64_t edge, onset, offset;   // cycles; offset 0 = still running
+    int edgeIndex;
+};
+
+struct Summary {
+    unsigned n;
+    double sum, sumSquares, min, max;
+};
+
+struct Options {
+    unsigned trials, itiMin, itiMax, seed;
+    const char *script;
+    double durationMs, maxErrorUs, maxLatencyUs, maxRearmUs, maxJitterUs,
+           maxEventJitterUs;
+    FILE *csv;
+};
+
+// maxLatencyUs 0: the firmware's onset bound, read after setup()
+static Options options = { 20, 800, 2500, 1, 0, 350, 10, 0, 40, 5, 10, 0 };
+
+// --------------------- Virtual session ----------------------
+
+// Run loop() passes up to the given cycle
+static void runUntil(uint64_t end) {
+    while (halFakeCycles() < end) {
+        loop();
+        halFakeAdvance(LOOP_IDLE_CYCLES);
+    }
+}
+
+// Edges at the given cycles (sorted) while loop() keeps running, then
+// until every tone is over. The fake latches each edge on its cycle and
+// takes it when interrupts are next on, so interrupts-off sections in
+// loop() and the ISRs show up as latency and jitter
+static void playEdges(const std::vector<uint64_t> &at) {
+    for (size_t i = 0; i < at.size(); i++) halFakeTriggerAt(at[i]);
+    uint64_t quiet = (uint64_t)(options.durationMs * 2 + SETTLE_MS) *
+                     CYCLES_PER_MS;
+    runUntil((at.empty() ? halFakeCycles() : at.back()) + quiet);
+}
+
+// Onset / offset pairs from the AD9833 control words of the bus log. A
+// tone's edge is the first one after the previous tone's edge that came
+// once that tone was over (edges during it were dropped), else the first
+// one after the previous tone's edge (queued, or restarting it)
+static std::vector<Tone> tonesFromBus(const std::vector<uint64_t> &edges) {
+    std::vector<uint64_t> cycles;
+    std::vector<uint16_t> words = halFakeSpiWordsTo(FSYNC_PIN, &cycles);
+    std::vector<Tone> tones;
+    bool running = false;
+    size_t next = 0;                            // first edge not yet matched
+    for (size_t i = 0; i < words.size(); i++) {
+        if (words[i] & 0xC000) continue;        // FREQ / PHASE write
+        bool reset = words[i] & RESET_BIT;
+        if (!running && !reset) {
+            Tone t = { 0, cycles[i], 0, -1 };
+            uint64_t ended = tones.empty() ? 0 : tones.back().offset;
+            size_t e = next;
+            while (e < edges.size() && edges[e] < cycles[i] && edges[e] < ended)
+                e++;
+            if (e == edges.size() || edges[e] >= cycles[i]) e = next;
+            if (e < edges.size() && edges[e] < cycles[i]) {
+                t.edge = edges[e];
+                t.edgeIndex = (int)e;
+                next = e + 1;
+            }
+            tones.push_back(t);
+        } else if (running && reset) {
+            tones.back().offset = cycles[i];
+        }
+        running = !reset;
+    }
+    return tones;
+}
+
+// --------------------- Statistics ----------------------
+
+static void add(Summary &s, double v) {
+    if (!s.n || v < s.min) s.min = v;
+    if (!s.n || v > s.max) s.max = v;
+    s.n++;
+    s.sum += v;
+    s.sumSquares += v * v;
+}
+
+static double usOf(uint64_t cycles) {
+    return (double)cycles / HAL_CYCLES_PER_US;
+}
+
+static void printSummary(const char *name, const Summary &s, bool last) {
+    if (!s.n) {
+        printf("      \"%s\": null%s\n", name, last ? "" : ",");
+        return;
+    }
+    double mean = s.sum / s.n;
+    double var = s.n > 1 ? (s.sumSquares - s.sum * mean) / (s.n - 1) : 0;
+    printf("      \"%s\": { \"n\": %u, \"min\": %.3f, \"mean\": %.3f, "
+           "\"max\": %.3f, \"sd\": %.3f }%s\n", name, s.n, s.min, mean,
+           s.max, var > 0 ? sqrt(var) : 0.0, last ? "" : ",");
+}
+
+static double maxAbs(const Summary &s) {
+    return s.n ? fmax(fabs(s.min), fabs(s.max)) : 0;
+}
+
+// Edge came while the previous tone still played, so it waited for it
+static bool held(const std::vector<Tone> &tones, size_t i) {
+    return i > 0 && tones[i].edgeIndex >= 0 && tones[i - 1].offset &&
+           tones[i].edge < tones[i - 1].offset;
+}
+
+// --------------------- Scenarios ----------------------
+
+// Play one schedule (cycles relative to its start) and print its report.
+// A negative jitterLimit reports the jitter without limiting it
+static bool scenario(const char *name, const std::vector<uint64_t> &offsets,
+                     double jitterLimit, bool first) {
+    runUntil(halFakeCycles() + (uint64_t)SETTLE_MS * CYCLES_PER_MS);
+    halFakeClearBusLog();
+    uint64_t start = halFakeCycles();
+    std::vector<uint64_t> at;
+    for (size_t i = 0; i < offsets.size(); i++) at.push_back(start + offsets[i]);
+
+    playEdges(at);
+    std::vector<Tone> tones = tonesFromBus(at);
+
+    double expectedUs = options.durationMs * 1000;
+    Summary onTime = {}, error = {}, latency = {}, rearm = {}, jitter = {};
+    unsigned unfinished = 0;
+    for (size_t i = 0; i < tones.size(); i++) {
+        const Tone &t = tones[i];
+        if (!t.offset) {
+            unfinished++;
+            continue;
+        }
+        double us = usOf(t.offset - t.onset);
+        add(onTime, us);
+        add(error, us - expectedUs);
+        if (held(tones, i)) add(rearm, usOf(t.onset - tones[i - 1].offset));
+        else if (t.edgeIndex >= 0) add(latency, usOf(t.onset - t.edge));
+        if (i > 0 && t.edgeIndex >= 0 && !held(tones, i) &&
+            tones[i - 1].edgeIndex >= 0 && !held(tones, i - 1)) {
+            add(jitter, usOf(t.onset - tones[i - 1].onset) -
+                        usOf(t.edge - tones[i - 1].edge));
+        }
+        if (options.csv) {
+            fprintf(options.csv, "%s,%zu,%d,%.4f,%.4f,%.3f,%.3f\n", name, i + 1,
+                    t.edgeIndex + 1, usOf(t.edge - start) / 1000,
+                    usOf(t.onset - start) / 1000,
+                    t.edgeIndex >= 0 ? usOf(t.onset - t.edge) : -1.0, us);
+        }
+    }
+
+    bool pass = tones.size() > 0 && !unfinished &&
+                maxAbs(error) <= options.maxErrorUs &&
+                maxAbs(latency) <= options.maxLatencyUs &&
+                maxAbs(rearm) <= options.maxRearmUs &&
+                (jitterLimit < 0 || maxAbs(jitter) <= jitterLimit);
+
+    printf("%s    {\n", first ? "" : ",\n");
+    printf("      \"name\": \"%s\",\n", name);
+    printf("      \"edges\": %zu,\n", at.size());
+    printf("      \"tones\": %zu,\n", tones.size());
+    printf("      \"unfinished\": %u,\n", unfinished);
+    printSummary("on_time_us", onTime, false);
+    printSummary("on_time_error_us", error, false);
+    printf("      \"on_time_max_abs_error_us\": %.3f,\n", maxAbs(error));
+    printSummary("onset_latency_us", latency, false);
+    printSummary("rearm_us", rearm, false);
+    printSummary("inter_onset_jitter_us", jitter, false);
+    printf("      \"inter_onset_max_abs_jitter_us\": %.3f,\n", maxAbs(jitter));
+    if (jitterLimit >= 0)
+        printf("      \"max_jitter_us\": %.3f,\n", jitterLimit);
+    printf("      \"pass\": %s\n    }", pass ? "true" : "false");
+    return pass;
+}
+
+static uint64_t msToCycles(double ms) {
+    return (uint64_t)(ms * CYCLES_PER_MS + 0.5);
+}
+
+// Realistic session: uniform ITIs from a fixed seed, so runs compare
+static std::vector<uint64_t> itiSchedule() {
+    std::vector<uint64_t> at;
+    uint32_t state = options.seed;
+    uint64_t t = 0;
+    for (unsigned i = 0; i < options.trials; i++) {
+        at.push_back(t);
+        state = state * 1664525UL + 1013904223UL;
+        unsigned span = options.itiMax - options.itiMin + 1;
+        t += msToCycles(options.itiMin + (state >> 8) % span);
+    }
+    return at;
+}
+
+// Edge pairs closer than any tone: the second one is queued or dropped
+static std::vector<uint64_t> doubleSchedule() {
+    static const double gapsUs[] = { 2, 5, 20, 100, 1000 };
+    std::vector<uint64_t> at;
+    uint64_t t = 0;
+    for (size_t i = 0; i < sizeof(gapsUs) / sizeof(gapsUs[0]); i++) {
+        at.push_back(t);
+        at.push_back(t + msToCycles(gapsUs[i] / 1000));
+        t += msToCycles(options.durationMs * 2 + SETTLE_MS);
+    }
+    return at;
+}
+
+// A second edge around the expected end of the first tone. The onset
+// latency is a few us, so the nominal end is edge + duration
+static std::vector<uint64_t> atEndSchedule() {
+    static const double offsetsUs[] = { -1000, -20, -2, 0, 2, 20, 1000 };
+    std::vector<uint64_t> at;
+    uint64_t t = 0;
+    for (size_t i = 0; i < sizeof(offsetsUs) / sizeof(offsetsUs[0]); i++) {
+        at.push_back(t);
+        at.push_back(t + msToCycles(options.durationMs + offsetsUs[i] / 1000));
+        t += msToCycles(options.durationMs * 3 + SETTLE_MS);
+    }
+    return at;
+}
+
+static bool readScript(const char *path, std::vector<uint64_t> &at) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    double ms;
+    while (fscanf(f, "%lf", &ms) == 1) at.push_back(msToCycles(ms));
+    fclose(f);
+    for (size_t i = 1; i < at.size(); i++) {
+        if (at[i] < at[i - 1]) return false;
+    }
+    return !at.empty();
+}
+
+// --------------------- Main ----------------------
+
+static bool parseArgs(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        bool more = i + 1 < argc;
+        if (!strcmp(a, "--trials") && more) {
+            options.trials = atoi(argv[++i]);
+        } else if (!strcmp(a, "--iti-ms") && i + 2 < argc) {
+            options.itiMin = atoi(argv[++i]);
+            options.itiMax = atoi(argv[++i]);
+        } else if (!strcmp(a, "--seed") && more) {
+            options.seed = strtoul(argv[++i], 0, 0);
+        } else if (!strcmp(a, "--script") && more) {
+            options.script = argv[++i];
+        } else if (!strcmp(a, "--duration-ms") && more) {
+            options.durationMs = atof(argv[++i]);
+        } else if (!strcmp(a, "--max-error-us") && more) {
+            options.maxErrorUs = atof(argv[++i]);
+        } else if (!strcmp(a, "--max-latency-us") && more) {
+            options.maxLatencyUs = atof(argv[++i]);
+        } else if (!strcmp(a, "--max-rearm-us") && more) {
+            options.maxRearmUs = atof(argv[++i]);
+        } else if (!strcmp(a, "--max-jitter-us") && more) {
+            options.maxJitterUs = atof(argv[++i]);
+        } else if (!strcmp(a, "--max-event-jitter-us") && more) {
+            options.maxEventJitterUs = atof(argv[++i]);
+        } else if (!strcmp(a, "--csv") && more) {
+            options.csv = fopen(argv[++i], "w");
+            if (!options.csv) {
+                perror(argv[i]);
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return options.trials > 0 && options.itiMin > 0 &&
+           options.itiMin <= options.itiMax && options.durationMs > 0;
+}
+
+int main(int argc, char **argv) {
+    if (!parseArgs(argc, argv)) {
+        fprintf(stderr, "usage: %s [--trials N] [--iti-ms MIN MAX] [--seed S] "
+                "[--script FILE] [--duration-ms MS] [--max-error-us US] "
+                "[--max-latency-us US] [--max-rearm-us US] "
+                "[--max-jitter-us US] [--max-event-jitter-us US] "
+                "[--csv FILE]\n", argv[0]);
+        return 2;
+    }
+    std::vector<uint64_t> script;
+    if (options.script && !readScript(options.script, script)) {
+        fprintf(stderr, "%s: no edge times, or not in order\n", options.script);
+        return 2;
+    }
+    if (options.csv) {
+        fprintf(options.csv, "scenario,tone,edge,edge_ms,onset_ms,"
+                "latency_us,on_time_us\n");
+    }
+
+    setup();
+    if (options.maxLatencyUs <= 0)
+        options.maxLatencyUs = usOf(tonePlan.OnsetBoundCycles());
+    bool pass = true;
+    printf("{\n  \"bench\": \"duration_jitter\",\n");
+    printf("  \"duration_us\": %.0f,\n", options.durationMs * 1000);
+    printf("  \"max_error_us\": %.3f,\n", options.maxErrorUs);
+    printf("  \"max_latency_us\": %.3f,\n", options.maxLatencyUs);
+    printf("  \"max_rearm_us\": %.3f,\n", options.maxRearmUs);
+    printf("  \"scenarios\": [\n");
+    pass &= scenario("iti", itiSchedule(), options.maxJitterUs, true);
+    pass &= scenario("double", doubleSchedule(), options.maxEventJitterUs,
+                     false);
+    pass &= scenario("at_end", atEndSchedule(), options.maxEventJitterUs,
+                     false);
+    if (!script.empty()) pass &= scenario("script", script, -1, false);
+    printf("\n  ],\n  \"pass\": %s\n}\n", pass ? "true" : "false");
+
+    if (options.csv) fclose(options.csv);
+    return pass ? 0 : 1;
+}
+
+#endif
@@ -23,20 +23,23 @@
  * 
  */
 
+#include <math.h>
 #include "AD9833.h"
 
 /*
  * Create an AD9833 object
  */
-AD9833 :: AD9833 ( uint8_t FNCpin, uint32_t referenceFrequency ) {
+AD9833 :: AD9833 ( uint8_t FNCpin, uint32_t referenceFrequency ) :
+	AD9833(FNCpin, referenceFrequency, WriteWordsTo) {
+}
+
+AD9833 :: AD9833 ( uint8_t FNCpin, uint32_t referenceFrequency,
+		WordWriter writer ) {
 	// Pin used to enable SPI communication (active LOW)
-#ifdef FNC_PIN
-	pinMode(FNC_PIN,OUTPUT);
-#else
-	this->FNCpin = FNCpin;
-	pinMode(FNCpin,OUTPUT);
-#endif
+	fsync = halPin(FNCpin);
+	halPinMode(FNCpin,OUTPUT);
 	WRITE_FNCPIN(HIGH);
+	this->writer = writer;
 
 	/* TODO: The minimum resolution and max frequency are determined by
 	 * by referenceFrequency. We should calculate these values and use
@@ -54,16 +57,26 @@ AD9833 :: AD9833 ( uint8_t FNCpin, uint32_t referenceFrequency ) {
 	frequency0 = frequency1 = 1000;		// 1 KHz sine wave to start
 	phase0 = phase1 = 0.0;				// 0 phase
 	activeFreq = REG0; activePhase = REG0;
+
+	controlShadow = 0;
+	freqShadow[0] = freqShadow[1] = 0;
+	phaseShadow[0] = phaseShadow[1] = 0;
+	shadowValid = 0;					// Chip state unknown at power on
+	burstCount = burstDepth = 0;
 }
 
 /*
  * This MUST be the first command after declaring the AD9833 object
- * Start SPI and place the AD9833 in the RESET state
+ * Start SPI and place the AD9833 in the RESET state. Without settle the
+ * RESET word goes out at once and takes effect within a few MCLK cycles,
+ * so the output is silent microseconds after the call
  */
-void AD9833 :: Begin ( void ) {
-	SPI.begin();
-	delay(100);
-	Reset();	// Hold in RESET until first WriteRegister command
+void AD9833 :: Begin ( bool settle ) {
+	halSpiBegin();
+	if ( settle ) halDelay(100);
+	Invalidate();
+	WriteReset();	// Hold in RESET until first WriteRegister command
+	if ( settle ) halDelay(15);
 }
 
 /*
@@ -75,10 +88,14 @@ void AD9833 :: Begin ( void ) {
 void AD9833 :: ApplySignal ( WaveformType waveType,
 		Registers freqReg, float frequencyInHz,
 		Registers phaseReg, float phaseInDeg ) {
+	PROBE_BEGIN(start);
+	BeginBurst();			// All words go out in one SPI transaction
 	SetFrequency ( freqReg, frequencyInHz );
 	SetPhase ( phaseReg, phaseInDeg );
 	SetWaveform ( freqReg, waveType );
 	SetOutputSource ( freqReg, phaseReg );
+	EndBurst();
+	PROBE_END(PROBE_APPLY, start);
 }
 
 /***********************************************************************
@@ -126,8 +143,8 @@ D0	Reserved. Must be 0.
  * state.
  */
 void AD9833 :: Reset ( void ) {
-	WriteRegister(RESET_CMD);
-	delay(15);
+	WriteReset();
+	halDelay(15);
 }
 
 /*
@@ -147,21 +164,14 @@ void AD9833 :: SetFrequency ( Registers freqReg, float frequency ) {
 	else frequency1 = frequency;
 	
 	int32_t freqWord = (frequency * pow2_28) / (float)refFrequency;
-	int16_t upper14 = (int16_t)((freqWord & 0xFFFC000) >> 14), 
-			lower14 = (int16_t)(freqWord & 0x3FFF);
-
-	// Which frequency register are we updating?
-	uint16_t reg = freqReg == REG0 ? FREQ0_WRITE_REG : FREQ1_WRITE_REG;
-	lower14 |= reg;
-	upper14 |= reg;   
+	WriteFrequencyWord(freqReg == REG0 ? 0 : 1, freqWord);
+}
 
-	// I do not reset the registers during write. It seems to remove
-	// 'glitching' on the outputs.
-	WriteControlRegister();
-	// Control register has already been setup to accept two frequency
-	// writes, one for each 14 bit part of the 28 bit frequency word
-	WriteRegister(lower14);			// Write lower 14 bits to AD9833
-	WriteRegister(upper14);			// Write upper 14 bits to AD9833
+/*
+ * Set the specified frequency register with a precomputed tuning word
+ */
+void AD9833 :: SetFrequencyWord ( Registers freqReg, uint32_t freqWord ) {
+	WriteFrequencyWord(freqReg == REG1 ? 1 : 0, freqWord);
 }
 
 /*
@@ -186,17 +196,23 @@ void AD9833 :: SetPhase ( Registers phaseReg, float phaseInDeg ) {
 	// Phase is in float degrees ( 0.0 - 360.0 )
 	// Convert to a number 0 to 4096 where 4096 = 0 by masking
 	uint16_t phaseVal = (uint16_t)(BITS_PER_DEG * phaseInDeg) & 0x0FFF;
-	phaseVal |= PHASE_WRITE_CMD;
 	
 	// Save phase for use by IncrementPhase function
 	if ( phaseReg == REG0 )	{
 		phase0 = phaseInDeg;
+		WritePhaseWord(0, phaseVal);
 	}
 	else {
 		phase1 = phaseInDeg;
-		phaseVal |= PHASE1_WRITE_REG;
+		WritePhaseWord(1, phaseVal);
 	}
-	WriteRegister(phaseVal);
+}
+
+/*
+ * Set the specified phase register with a precomputed 12 bit value
+ */
+void AD9833 :: SetPhaseValue ( Registers phaseReg, uint16_t phaseValue ) {
+	WritePhaseWord(phaseReg == REG1 ? 1 : 0, phaseValue & 0x0FFF);
 }
 
 /*
@@ -227,8 +243,10 @@ void AD9833 :: SetWaveform (  Registers waveFormReg, WaveformType waveType ) {
  * EnableOutput(true). See the Reset function description.
  */
 void AD9833 :: EnableOutput ( bool enable ) {
+	PROBE_BEGIN(start);
 	outputEnabled = enable;
 	WriteControlRegister();
+	if ( enable ) PROBE_END(PROBE_ENABLE, start);
 }
 
 /*
@@ -244,6 +262,58 @@ void AD9833 :: SetOutputSource ( Registers freqReg, Registers phaseReg ) {
 	WriteControlRegister();
 }
 
+/*
+ * Load a signal into the staging register pair. The control word is not
+ * touched except for the B28 write that precedes a frequency update,
+ * and that one is skipped when the shadow already matches.
+ */
+void AD9833 :: StageSignal ( WaveformType waveType, float frequencyInHz,
+		float phaseInDeg ) {
+	Registers reg = StagingRegister();
+	BeginBurst();
+	SetFrequency(reg, frequencyInHz);
+	SetPhase(reg, phaseInDeg);
+	EndBurst();
+	if ( reg == REG0 ) waveForm0 = waveType;
+	else waveForm1 = waveType;
+}
+
+/*
+ * Same as StageSignal with precomputed words (see AD9833Words.h)
+ */
+void AD9833 :: StageWords ( WaveformType waveType, uint32_t freqWord,
+		uint16_t phaseValue ) {
+	Registers reg = StagingRegister();
+	BeginBurst();
+	SetFrequencyWord(reg, freqWord);
+	SetPhaseValue(reg, phaseValue);
+	EndBurst();
+	if ( reg == REG0 ) waveForm0 = waveType;
+	else waveForm1 = waveType;
+}
+
+/*
+ * Output the staged registers: flips FSELECT and PSELECT together, and
+ * releases or sets RESET, in one control word.
+ */
+void AD9833 :: SwitchToStaged ( bool enable ) {
+	activeFreq = activePhase = StagingRegister();
+	outputEnabled = enable;
+	WriteControlRegister();
+}
+
+uint16_t AD9833 :: SwitchWord ( bool enable ) const {
+	Registers reg = StagingRegister();
+	return ControlWord(reg, reg, enable);
+}
+
+void AD9833 :: SwitchedExternally ( bool enable ) {
+	activeFreq = activePhase = StagingRegister();
+	outputEnabled = enable;
+	controlShadow = ControlWord(activeFreq, activePhase, enable);
+	shadowValid |= SHADOW_CONTROL;
+}
+
 //---------- LOWER LEVEL FUNCTIONS NOT NORMALLY NEEDED -------------
 
 /*
@@ -301,18 +371,116 @@ float AD9833 :: GetResolution ( void ) {
 	return (float)refFrequency / (float)pow2_28;
 }
 
+// ------------------- SHADOW REGISTER FUNCTIONS ---------------------
+
+/*
+ * Forget what the chip holds. Use after a power cycle, or after another
+ * piece of code (e.g. a TriggerPlan) wrote to the AD9833 directly.
+ */
+void AD9833 :: Invalidate ( uint8_t registers ) {
+	shadowValid &= ~registers;
+}
+
+/*
+ * Rewrite all shadowed registers, e.g. after a brown-out of the AD9833
+ */
+void AD9833 :: Flush ( void ) {
+	Invalidate();
+	BeginBurst();
+	WriteFrequencyWord(0, freqShadow[0]);
+	WriteFrequencyWord(1, freqShadow[1]);
+	WritePhaseWord(0, phaseShadow[0]);
+	WritePhaseWord(1, phaseShadow[1]);
+	WriteControlRegister();
+	EndBurst();
+}
+
+/*
+ * Send words back to back under one SPI transaction. Each word is
+ * written with interrupts off (about 2 us at 8 MHz), so an ISR that
+ * drives the same bus (TriggerPlan) can never split a word or race the
+ * FSYNC port write.
+ */
+void AD9833 :: WriteWords ( const uint16_t *words, uint8_t count ) {
+	if ( count ) writer(fsync, words, count);
+}
+
 // --------------------- PRIVATE FUNCTIONS --------------------------
 
+/*
+ * The run-time pin writer. AD9833Fast has the same loop with the pin
+ * compiled in.
+ */
+void AD9833 :: WriteWordsTo ( const HalPin &fsync, const uint16_t *words,
+		uint8_t count ) {
+	halSpiBeginTransaction(AD9833_SPI_CLOCK, HAL_SPI_MODE2);
+	for ( uint8_t i = 0; i < count; i++ ) {
+		HalIrqState state = halIrqSave();
+		WRITE_FNCPIN(LOW);
+		halSpiWriteRaw(highByte(words[i]));
+		halSpiWriteRaw(lowByte(words[i]));
+		WRITE_FNCPIN(HIGH);
+		halIrqRestore(state);
+	}
+	halSpiEndTransaction();
+}
+
+/*
+ * RESET control word, without the settling delay of Reset()
+ */
+void AD9833 :: WriteReset ( void ) {
+	WriteRegister(RESET_CMD);
+	controlShadow = RESET_CMD;
+	shadowValid |= SHADOW_CONTROL;
+}
+
+/*
+ * Write a 28 bit frequency word unless the register already holds it
+ */
+void AD9833 :: WriteFrequencyWord ( uint8_t reg, uint32_t freqWord ) {
+	uint8_t valid = reg == 0 ? SHADOW_FREQ0 : SHADOW_FREQ1;
+	freqWord &= 0x0FFFFFFFUL;
+	if ( (shadowValid & valid) && freqShadow[reg] == freqWord ) return;
+
+	int16_t upper14 = (int16_t)((freqWord & 0xFFFC000) >> 14), 
+			lower14 = (int16_t)(freqWord & 0x3FFF);
+
+	// Which frequency register are we updating?
+	uint16_t cmd = reg == 0 ? FREQ0_WRITE_REG : FREQ1_WRITE_REG;
+	lower14 |= cmd;
+	upper14 |= cmd;   
+
+	// I do not reset the registers during write. It seems to remove
+	// 'glitching' on the outputs.
+	WriteControlRegister();
+	// Control register has already been setup to accept two frequency
+	// writes, one for each 14 bit part of the 28 bit frequency word
+	WriteRegister(lower14);			// Write lower 14 bits to AD9833
+	WriteRegister(upper14);			// Write upper 14 bits to AD9833
+
+	freqShadow[reg] = freqWord;
+	shadowValid |= valid;
+}
+
+/*
+ * Write a 12 bit phase word unless the register already holds it
+ */
+void AD9833 :: WritePhaseWord ( uint8_t reg, uint16_t phaseVal ) {
+	uint8_t valid = reg == 0 ? SHADOW_PHASE0 : SHADOW_PHASE1;
+	if ( (shadowValid & valid) && phaseShadow[reg] == phaseVal ) return;
+
+	WriteRegister(PHASE_WRITE_CMD | (reg == 0 ? 0 : PHASE1_WRITE_REG) | phaseVal);
+	phaseShadow[reg] = phaseVal;
+	shadowValid |= valid;
+}
+
 /*
  * Write control register. Setup register based on defined states
  */
-void AD9833 :: WriteControlRegister ( void ) {
+uint16_t AD9833 :: ControlWord ( Registers freqReg, Registers phaseReg,
+		bool enable ) const {
 	uint16_t waveForm;
-	// TODO: can speed things up by keeping a writeReg0 and writeReg1
-	// that presets all bits during the various setup function calls
-	// rather than setting flags. Then we could just call WriteRegister
-	// directly.
-	if ( activeFreq == REG0 ) {
+	if ( freqReg == REG0 ) {
 		waveForm = waveForm0;
 		waveForm &= ~FREQ1_OUTPUT_REG;
 	}
@@ -320,11 +488,11 @@ void AD9833 :: WriteControlRegister ( void ) {
 		waveForm = waveForm1;
 		waveForm |= FREQ1_OUTPUT_REG;
 	}
-	if ( activePhase == REG0 )
+	if ( phaseReg == REG0 )
 		waveForm &= ~PHASE1_OUTPUT_REG;
 	else
 		waveForm |= PHASE1_OUTPUT_REG;
-	if ( outputEnabled )
+	if ( enable )
 		waveForm &= ~RESET_CMD;
 	else
 		waveForm |= RESET_CMD;
@@ -336,29 +504,46 @@ void AD9833 :: WriteControlRegister ( void ) {
 		waveForm |= DISABLE_INT_CLK;
 	else
 		waveForm &= ~DISABLE_INT_CLK;
+	return waveForm;
+}
 
+void AD9833 :: WriteControlRegister ( void ) {
+	uint16_t waveForm = ControlWord(activeFreq, activePhase, outputEnabled);
+
+	// The control word is shadowed like the other registers, so setters
+	// that leave it unchanged cost no SPI traffic
+	if ( (shadowValid & SHADOW_CONTROL) && controlShadow == waveForm )
+		return;
 	WriteRegister ( waveForm );
+	controlShadow = waveForm;
+	shadowValid |= SHADOW_CONTROL;
 }
 
+/*
+ * Queue a word while a burst is open, otherwise send it right away.
+ * The transaction sets mode 2 and the clock every time, because other
+ * hardware may be doing SPI also.
+ */
 void AD9833 :: WriteRegister ( int16_t dat ) {
-	/*
-	 * We set the mode here, because other hardware may be doing SPI also
-	 */
-	SPI.setDataMode(SPI_MODE2);
-
-	/* Improve overall switching speed
-	 * Note, the times are for this function call, not the write.
-	 * digitalWrite(FNCpin)			~ 17.6 usec
-	 * digitalWriteFast2(FNC_PIN)	~  8.8 usec
-	 */
-	WRITE_FNCPIN(LOW);		// FNCpin low to write to AD9833
-
-	//delayMicroseconds(2);	// Some delay may be needed
+	if ( !burstDepth ) {
+		uint16_t word = dat;
+		WriteWords(&word, 1);
+		return;
+	}
+	if ( burstCount == AD9833_BURST_MAX ) {
+		WriteWords(burst, burstCount);
+		burstCount = 0;
+	}
+	burst[burstCount++] = dat;
+}
 
-	// TODO: Are we running at the highest clock rate?
-	SPI.transfer(highByte(dat));	// Transmit 16 bits 8 bits at a time
-	SPI.transfer(lowByte(dat));
+void AD9833 :: BeginBurst ( void ) {
+	burstDepth++;
+}
 
-	WRITE_FNCPIN(HIGH);		// Write done
+void AD9833 :: EndBurst ( void ) {
+	if ( --burstDepth ) return;
+	WriteWords(burst, burstCount);
+	burstCount = 0;
 }
 
@@ -25,18 +25,16 @@
 
 #define __AD9833__
 
-#include <Arduino.h>
-#include <SPI.h>
+#include "Hal.h"
+#include "Probe.h"
 
-//#define FNC_PIN 4			// Define FNC_PIN for fast digital writes
+// The FSYNC pin is resolved to a port / mask in the constructor. When it
+// is known at compile time use AD9833Fast<pin> (below) instead: its FSYNC
+// writes compile to single SBI / CBI instructions.
+#define WRITE_FNCPIN(Val) ((Val) ? halPinHigh(fsync) : halPinLow(fsync))
 
-#ifdef FNC_PIN
-	// Use digitalWriteFast for a speedup
-	#include "digitalWriteFast.h"
-	#define WRITE_FNCPIN(Val) digitalWriteFast2(FNC_PIN,(Val))
-#else  // otherwise, just use digitalWrite
-	#define WRITE_FNCPIN(Val) digitalWrite(FNCpin,(Val))
-#endif
+#define AD9833_SPI_CLOCK	8000000UL	// F_CPU / 2, the AD9833 takes 40 MHz
+#define AD9833_BURST_MAX	8			// words buffered by ApplySignal / Flush
 
 #define pow2_28				268435456L	// 2^28 used in frequency word calculation
 #define BITS_PER_DEG		11.3777777777778	// 4096 / 360
@@ -62,6 +60,14 @@ typedef enum { SINE_WAVE = 0x2000, TRIANGLE_WAVE = 0x2002,
 
 typedef enum { REG0, REG1, SAME_AS_REG0 } Registers;
 
+// Shadow register valid bits
+#define SHADOW_CONTROL		0x01
+#define SHADOW_FREQ0		0x02
+#define SHADOW_FREQ1		0x04
+#define SHADOW_PHASE0		0x08
+#define SHADOW_PHASE1		0x10
+#define SHADOW_ALL			0x1F
+
 class AD9833 {
 
 public:
@@ -69,7 +75,9 @@ public:
 	AD9833 ( uint8_t FNCpin, uint32_t referenceFrequency = 25000000UL );
 
 	// Must be the first command after creating the AD9833 object.
-	void Begin ( void );
+	// settle = false skips the power-up and RESET waits (115 ms) when the
+	// chip is known to be powered, e.g. after a reset of the MCU alone
+	void Begin ( bool settle = true );
 
 	// Setup and apply a signal. Note that any calls to EnableOut,
 	// SleepMode, DisableDAC, or DisableInternalClock remain in effect
@@ -84,12 +92,19 @@ public:
 	// Update just the frequency in REG0 or REG1
 	void SetFrequency ( Registers freqReg, float frequency );
 
+	// Load a precomputed 28 bit tuning word (see AD9833Words.h). No float
+	// math; IncrementFrequency() still steps from the last SetFrequency()
+	void SetFrequencyWord ( Registers freqReg, uint32_t freqWord );
+
 	// Increment the selected frequency register by freqIncHz
 	void IncrementFrequency ( Registers freqReg, float freqIncHz );
 
 	// Update just the phase in REG0 or REG1
 	void SetPhase ( Registers phaseReg, float phaseInDeg );
 
+	// Load a precomputed 12 bit phase value (see AD9833Words.h)
+	void SetPhaseValue ( Registers phaseReg, uint16_t phaseValue );
+
 	// Increment the selected phase register by phaseIncDeg
 	void IncrementPhase ( Registers phaseReg, float phaseIncDeg );
 
@@ -103,6 +118,25 @@ public:
 	// Turn ON / OFF output using the RESET command.
 	void EnableOutput ( bool enable );
 
+	// Ping-pong staging. The next stimulus is loaded into the frequency
+	// and phase registers that are not being output, so the LSB/MSB
+	// writes cannot glitch the running tone. SwitchToStaged() then selects
+	// them (and sets RESET from enable) with a single control word.
+	Registers StagingRegister ( void ) const {
+		return activeFreq == REG1 ? REG0 : REG1;
+	}
+	void StageSignal ( WaveformType waveType, float frequencyInHz,
+		float phaseInDeg = 0.0 );
+	void StageWords ( WaveformType waveType, uint32_t freqWord,
+		uint16_t phaseValue );
+	void SwitchToStaged ( bool enable = true );
+
+	// The control word SwitchToStaged(enable) would write, for a caller
+	// that sends it itself (AD9833Group broadcasts it to several chips).
+	// SwitchedExternally() then records the switch as if it had been made
+	uint16_t SwitchWord ( bool enable = true ) const;
+	void SwitchedExternally ( bool enable = true );
+
 	// Enable/disable Sleep mode.  Internal clock and DAC disabled
 	void SleepMode ( bool enable );
 
@@ -121,19 +155,96 @@ public:
 	// Return frequency resolution
 	float GetResolution ( void );
 
+	// The driver keeps a shadow of the control word and of both FREQ and
+	// PHASE registers and skips SPI writes that would not change them.
+	// Forget what the chip holds, e.g. after a power cycle or after
+	// writing to it behind the driver's back. The next write of each
+	// register goes out unconditionally. Pass SHADOW_ bits to forget
+	// only some registers.
+	void Invalidate ( uint8_t registers = SHADOW_ALL );
+
+	// Write every shadow register to the chip, whether it changed or not
+	void Flush ( void );
+
+	// Send raw register words in one SPI transaction at AD9833_SPI_CLOCK,
+	// each framed by FSYNC. Bypasses the shadow registers, so call
+	// Invalidate() for the registers written.
+	void WriteWords ( const uint16_t *words, uint8_t count );
+
+protected:
+
+	// Sends count words, each framed by FSYNC, in one SPI transaction
+	typedef void (*WordWriter) ( const HalPin &fsync, const uint16_t *words,
+		uint8_t count );
+
+	AD9833 ( uint8_t FNCpin, uint32_t referenceFrequency, WordWriter writer );
+
 private:
 
+	static void		WriteWordsTo ( const HalPin &fsync, const uint16_t *words,
+						uint8_t count );
 	void 			WriteRegister ( int16_t dat );
+	void			WriteReset ( void );
+	void			BeginBurst ( void );
+	void			EndBurst ( void );
 	void 			WriteControlRegister ( void );
+	uint16_t		ControlWord ( Registers freqReg, Registers phaseReg,
+						bool enable ) const;
+	void			WriteFrequencyWord ( uint8_t reg, uint32_t freqWord );
+	void			WritePhaseWord ( uint8_t reg, uint16_t phaseVal );
+	uint16_t		controlShadow;
+	uint32_t		freqShadow[2];
+	uint16_t		phaseShadow[2];
+	uint8_t			shadowValid;
+	uint16_t		burst[AD9833_BURST_MAX];
+	uint8_t			burstCount, burstDepth;
 	uint16_t		waveForm0, waveForm1;
-#ifndef FNC_PIN
-	uint8_t			FNCpin;
-#endif
+	HalPin			fsync;
+	WordWriter		writer;
 	uint8_t			outputEnabled, DacDisabled, IntClkDisabled;
 	uint32_t		refFrequency;
 	float			frequency0, frequency1, phase0, phase1;
 	Registers		activeFreq, activePhase;
 };
 
+/*
+ * An AD9833 with its FSYNC pin and reference clock fixed at compile time:
+ *
+ *	AD9833Fast<2> gen;					// FSYNC on pin 2, 25 MHz MCLK
+ *
+ * The register logic and API are the AD9833's, so it goes wherever an
+ * AD9833 & does. Only the word writer differs: the pin is a template
+ * argument, so each FSYNC edge is one SBI / CBI (2 cycles) instead of a
+ * read-modify-write through the port pointer.
+ */
+template < uint8_t FsyncPin, uint32_t RefHz = 25000000UL >
+class AD9833Fast : public AD9833 {
+
+	static_assert(RefHz > 0 && RefHz <= 25000000UL,
+		"AD9833: reference clock must be 1 Hz - 25 MHz");
+
+public:
+
+	static const uint32_t REFERENCE_HZ = RefHz;
+
+	AD9833Fast ( void ) : AD9833(FsyncPin, RefHz, WriteWordsFast) { }
+
+private:
+
+	static void WriteWordsFast ( const HalPin &, const uint16_t *words,
+			uint8_t count ) {
+		halSpiBeginTransaction(AD9833_SPI_CLOCK, HAL_SPI_MODE2);
+		for ( uint8_t i = 0; i < count; i++ ) {
+			HalIrqState state = halIrqSave();
+			halPinLowFast<FsyncPin>();
+			halSpiWriteRaw(highByte(words[i]));
+			halSpiWriteRaw(lowByte(words[i]));
+			halPinHighFast<FsyncPin>();
+			halIrqRestore(state);
+		}
+		halSpiEndTransaction();
+	}
+};
+
 #endif
 
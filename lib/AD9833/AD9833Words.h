@@ -0,0 +1,106 @@
+/*
+ * AD9833Words.h
+ *
+ * Compile-time AD9833 register words for fixed stimuli.
+ *
+ * SetFrequency() and SetPhase() work in float Hz and degrees, which on
+ * the AVR means soft-float multiplies, a division and fmod() every time.
+ * When the stimulus is known at compile time the final words can be
+ * worked out by the compiler instead:
+ *
+ *	typedef AD9833Words<9500> Tone;			// 9500 Hz sine, 0 deg
+ *	gen.SetFrequencyWord(REG0, Tone::FREQ_WORD);
+ *
+ * Frequencies are integer Hz and phases tenths of a degree, so the words
+ * are exact integer arithmetic rounded to the nearest step. Out of range
+ * values fail the build through static_assert.
+ *
+ * The ad9833...() functions are constexpr as well and can be used on
+ * their own with run-time arguments.
+ */
+
+#ifndef AD9833Words_h
+#define AD9833Words_h
+
+#include "AD9833.h"
+
+#define AD9833_MAX_MCLK		25000000UL	// Datasheet maximum reference clock
+
+// 28 bit tuning word, rounded: f * 2^28 / MCLK
+constexpr uint32_t ad9833FreqWord ( uint32_t frequencyInHz,
+		uint32_t referenceFrequency = 25000000UL ) {
+	return (uint32_t)((((uint64_t)frequencyInHz << 28) +
+		referenceFrequency / 2) / referenceFrequency);
+}
+
+// FREQ0 / FREQ1 write of the lower and upper 14 bits of a tuning word
+constexpr uint16_t ad9833FreqLsb ( uint32_t freqWord, Registers freqReg = REG0 ) {
+	return (freqReg == REG1 ? FREQ1_WRITE_REG : FREQ0_WRITE_REG) |
+		(uint16_t)(freqWord & 0x3FFF);
+}
+
+constexpr uint16_t ad9833FreqMsb ( uint32_t freqWord, Registers freqReg = REG0 ) {
+	return (freqReg == REG1 ? FREQ1_WRITE_REG : FREQ0_WRITE_REG) |
+		(uint16_t)((freqWord >> 14) & 0x3FFF);
+}
+
+// 12 bit phase value, rounded: deg * 4096 / 360. 360 deg wraps to 0
+constexpr uint16_t ad9833PhaseValue ( uint16_t phaseInDeciDeg ) {
+	return (uint16_t)((((uint32_t)(phaseInDeciDeg % 3600) << 12) + 1800) /
+		3600) & 0x0FFF;
+}
+
+// PHASE0 / PHASE1 write of a phase value
+constexpr uint16_t ad9833PhaseWord ( uint16_t phaseValue, Registers phaseReg = REG0 ) {
+	return PHASE_WRITE_CMD | (phaseReg == REG1 ? PHASE1_WRITE_REG : 0) |
+		(phaseValue & 0x0FFF);
+}
+
+// Control word: B28 writes, waveform, output register, optional RESET
+constexpr uint16_t ad9833Control ( WaveformType waveType,
+		Registers freqReg = REG0, Registers phaseReg = REG0,
+		bool reset = false ) {
+	return (uint16_t)waveType |
+		(freqReg == REG1 ? FREQ1_OUTPUT_REG : 0) |
+		(phaseReg == REG1 ? PHASE1_OUTPUT_REG : 0) |
+		(reset ? RESET_CMD : 0);
+}
+
+/*
+ * All words of one fixed stimulus. The members are compile-time
+ * constants; use them by value.
+ */
+template < uint32_t FrequencyInHz, uint16_t PhaseInDeciDeg = 0,
+		   WaveformType WaveType = SINE_WAVE,
+		   uint32_t ReferenceFrequency = 25000000UL >
+struct AD9833Words {
+
+	static_assert(ReferenceFrequency > 0 &&
+		ReferenceFrequency <= AD9833_MAX_MCLK,
+		"AD9833: reference clock must be 1 Hz - 25 MHz");
+	static_assert(FrequencyInHz <= ReferenceFrequency / 2,
+		"AD9833: frequency above MCLK / 2");
+	static_assert(FrequencyInHz == 0 ||
+		ad9833FreqWord(FrequencyInHz, ReferenceFrequency) != 0,
+		"AD9833: frequency below the tuning resolution");
+	static_assert(PhaseInDeciDeg < 3600,
+		"AD9833: phase must be 0.0 - 359.9 deg (tenths of a degree)");
+
+	static constexpr uint32_t FREQ_WORD =
+		ad9833FreqWord(FrequencyInHz, ReferenceFrequency);
+	static constexpr uint16_t PHASE_VALUE = ad9833PhaseValue(PhaseInDeciDeg);
+
+	static constexpr uint16_t FREQ0_LSB = ad9833FreqLsb(FREQ_WORD, REG0);
+	static constexpr uint16_t FREQ0_MSB = ad9833FreqMsb(FREQ_WORD, REG0);
+	static constexpr uint16_t FREQ1_LSB = ad9833FreqLsb(FREQ_WORD, REG1);
+	static constexpr uint16_t FREQ1_MSB = ad9833FreqMsb(FREQ_WORD, REG1);
+	static constexpr uint16_t PHASE0 = ad9833PhaseWord(PHASE_VALUE, REG0);
+	static constexpr uint16_t PHASE1 = ad9833PhaseWord(PHASE_VALUE, REG1);
+
+	// Output from FREQ0 / PHASE0, running and held in RESET
+	static constexpr uint16_t CONTROL = ad9833Control(WaveType);
+	static constexpr uint16_t CONTROL_RESET =
+		ad9833Control(WaveType, REG0, REG0, true);
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * AD9833Group.cpp
+ *
+ * Synchronized AD9833 channels. See AD9833Group.h for an overview.
+ */
+
+#include "AD9833Group.h"
+
+AD9833Group :: AD9833Group ( AD9833 **devices, const uint8_t *fsyncPins,
+		uint8_t count ) {
+	if ( count > AD9833_GROUP_MAX ) count = AD9833_GROUP_MAX;
+	this->count = count;
+	broadcast = count > 0;
+	for ( uint8_t i = 0; i < count; i++ ) {
+		this->devices[i] = devices[i];
+		fsync[i] = halPin(fsyncPins[i]);
+		if ( i == 0 ) fsyncAll = fsync[0];
+		else if ( !halPinAdd(fsyncAll, fsyncPins[i]) ) broadcast = false;
+	}
+	skewTicks = maxSkewTicks = 0;
+}
+
+void AD9833Group :: Begin ( bool settle ) {
+	if ( settle ) halDelay(100);
+	for ( uint8_t i = 0; i < count; i++ ) devices[i]->Begin(false);
+	if ( settle ) halDelay(15);
+}
+
+/*
+ * The words are computed before interrupts go off, so the critical
+ * section is only SPI traffic: 2 bytes for a broadcast, 2 per channel
+ * otherwise.
+ */
+void AD9833Group :: Release ( bool enable ) {
+	if ( !count ) return;
+	uint16_t words[AD9833_GROUP_MAX];
+	bool shared = broadcast;
+	for ( uint8_t i = 0; i < count; i++ ) {
+		words[i] = devices[i]->SwitchWord(enable);
+		if ( words[i] != words[0] ) shared = false;
+	}
+
+	uint16_t first = 0, last = 0;
+	halSpiBeginTransaction(AD9833_SPI_CLOCK, HAL_SPI_MODE2);
+	HalIrqState state = halIrqSave();
+	if ( shared ) {
+		halPinLow(fsyncAll);
+		halSpiWriteRaw(highByte(words[0]));
+		halSpiWriteRaw(lowByte(words[0]));
+		halPinHigh(fsyncAll);
+	}
+	else {
+		for ( uint8_t i = 0; i < count; i++ ) {
+			halPinLow(fsync[i]);
+			halSpiWriteRaw(highByte(words[i]));
+			halSpiWriteRaw(lowByte(words[i]));
+			halPinHigh(fsync[i]);
+			last = halTimerNow();
+			if ( i == 0 ) first = last;
+		}
+	}
+	halIrqRestore(state);
+	halSpiEndTransaction();
+
+	skewTicks = last - first;
+	if ( skewTicks > maxSkewTicks ) maxSkewTicks = skewTicks;
+	for ( uint8_t i = 0; i < count; i++ ) devices[i]->SwitchedExternally(enable);
+}
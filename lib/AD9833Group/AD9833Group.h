@@ -0,0 +1,77 @@
+/*
+ * AD9833Group.h
+ *
+ * Several AD9833s on one SPI bus, one FSYNC line each, started together.
+ * Every channel is staged through its own driver, which keeps its own
+ * shadows and writes only its own FSYNC:
+ *
+ *	AD9833 left(2), right(5);
+ *	AD9833 *channels[] = { &left, &right };
+ *	const uint8_t fsyncPins[] = { 2, 5 };
+ *	AD9833Group dds(channels, fsyncPins, 2);
+ *
+ *	dds.Begin();
+ *	left.StageWords(SINE_WAVE, leftWord, 0);
+ *	right.StageWords(SINE_WAVE, rightWord, 0);
+ *	dds.Release(true);			// both tones start here
+ *
+ * StageWords() loads the idle FREQ/PHASE pair of each chip, so it can be
+ * done ahead of time. Release() then sends the control words that switch
+ * every chip to its staged pair, with interrupts off:
+ *
+ *  - when all channels need the same control word (same waveform and
+ *    staging pair, which Release() keeps in step), the word goes out once
+ *    with every FSYNC line low: all chips latch it on the same SCLK edge
+ *    and start within one MCLK period (40 ns) of each other
+ *  - otherwise one word per channel, back to back, ~2.5 us apart at 8 MHz
+ *    SPI, so four channels start within ~8 us
+ *
+ * The shared word needs all FSYNC pins on one port (pins 0-7, 8-13 or
+ * A0-A5 on the Nano); IsBroadcast() tells whether they are. The skew of
+ * the last release, from the first chip's latch to the last one's, is
+ * measured on Timer1 (ToneGate::Begin must have run) and kept with its
+ * maximum.
+ */
+
+#ifndef AD9833Group_h
+#define AD9833Group_h
+
+#include "AD9833.h"
+
+#define AD9833_GROUP_MAX	4
+
+class AD9833Group {
+
+public:
+
+	// Up to AD9833_GROUP_MAX devices and the FSYNC pin of each
+	AD9833Group ( AD9833 **devices, const uint8_t *fsyncPins, uint8_t count );
+
+	// Begin() every device behind one shared power-up wait
+	void Begin ( bool settle = true );
+
+	// Switch every device to its staged registers (and set RESET from
+	// enable) at the same time
+	void Release ( bool enable = true );
+
+	AD9833 &Channel ( uint8_t i ) { return *devices[i]; }
+	uint8_t Count ( void ) const { return count; }
+
+	// All FSYNC pins on one port, so a common control word is broadcast
+	bool IsBroadcast ( void ) const { return broadcast; }
+
+	// First to last channel latching the last / any release, Timer1 ticks
+	uint16_t SkewTicks ( void ) const { return skewTicks; }
+	uint16_t MaxSkewTicks ( void ) const { return maxSkewTicks; }
+
+private:
+
+	AD9833			*devices[AD9833_GROUP_MAX];
+	HalPin			fsync[AD9833_GROUP_MAX];
+	HalPin			fsyncAll;
+	uint8_t			count;
+	bool			broadcast;
+	uint16_t		skewTicks, maxSkewTicks;
+};
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * CommandLink.cpp
+ *
+ * Framed binary serial commands. See CommandLink.h for an overview.
+ */
+
+#include "CommandLink.h"
+
+CommandLink :: CommandLink ( void ) {
+	frame.command = frame.length = 0;
+	state = LINK_WAIT_SYNC;
+	count = crc = 0;
+	errors = 0;
+}
+
+/*
+ * One state per field. A bad length or CRC drops the frame and waits for
+ * the next sync byte.
+ */
+bool CommandLink :: Feed ( uint8_t b ) {
+	switch ( state ) {
+	case LINK_WAIT_SYNC:
+		if ( b == LINK_SYNC ) state = LINK_LENGTH;
+		return false;
+	case LINK_LENGTH:
+		if ( b > LINK_MAX_PAYLOAD ) {
+			Abort();
+			return false;
+		}
+		frame.length = b;
+		crc = Crc(0, b);
+		state = LINK_COMMAND;
+		return false;
+	case LINK_COMMAND:
+		frame.command = b;
+		crc = Crc(crc, b);
+		count = 0;
+		state = frame.length ? LINK_PAYLOAD : LINK_CRC;
+		return false;
+	case LINK_PAYLOAD:
+		frame.payload[count++] = b;
+		crc = Crc(crc, b);
+		if ( count == frame.length ) state = LINK_CRC;
+		return false;
+	default:
+		if ( b != crc ) {
+			Abort();
+			return false;
+		}
+		state = LINK_WAIT_SYNC;
+		return true;
+	}
+}
+
+void CommandLink :: Abort ( void ) {
+	if ( state != LINK_WAIT_SYNC ) errors++;
+	state = LINK_WAIT_SYNC;
+}
+
+uint8_t CommandLink :: Encode ( uint8_t *out, uint8_t command,
+		const uint8_t *payload, uint8_t length ) {
+	if ( length > LINK_MAX_PAYLOAD ) length = LINK_MAX_PAYLOAD;
+	uint8_t n = 0;
+	out[n++] = LINK_SYNC;
+	out[n++] = length;
+	out[n++] = command;
+	for ( uint8_t i = 0; i < length; i++ ) out[n++] = payload[i];
+
+	uint8_t c = 0;
+	for ( uint8_t i = 1; i < n; i++ ) c = Crc(c, out[i]);
+	out[n++] = c;
+	return n;
+}
+
+uint8_t CommandLink :: Reply ( uint8_t *out, uint8_t command, uint8_t status,
+		const uint8_t *data, uint8_t length ) {
+	uint8_t payload[LINK_MAX_PAYLOAD];
+	if ( length > LINK_MAX_PAYLOAD - 1 ) length = LINK_MAX_PAYLOAD - 1;
+	payload[0] = status;
+	for ( uint8_t i = 0; i < length; i++ ) payload[i + 1] = data[i];
+	return Encode(out, command | LINK_REPLY, payload, length + 1);
+}
+
+// --------------------- PRIVATE FUNCTIONS --------------------------
+
+/*
+ * CRC-8, polynomial 0x07, MSB first (avr-libc _crc8_ccitt_update)
+ */
+uint8_t CommandLink :: Crc ( uint8_t crc, uint8_t b ) {
+	crc ^= b;
+	for ( uint8_t i = 0; i < 8; i++ )
+		crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+	return crc;
+}
@@ -0,0 +1,139 @@
+/*
+ * CommandLink.h
+ *
+ * Framed binary commands on the serial link, next to the text event log.
+ * Every frame, in both directions:
+ *
+ *	0xA5  length  command  payload[length]  crc
+ *
+ * length counts the payload bytes only (0 - LINK_MAX_PAYLOAD) and crc is
+ * CRC-8 (polynomial 0x07, initial 0) over length, command and payload.
+ * Multi-byte fields are little endian. The log is plain ASCII, so 0xA5
+ * never occurs in it and a host finds replies by their sync byte; a reply
+ * is written whole, but may fall between two parts of a log line.
+ *
+ * A reply carries the command | LINK_REPLY and a status byte as the first
+ * payload byte, followed by the data listed below. Frames with a bad CRC
+ * are counted and get no reply.
+ *
+ *	command			request payload				reply data
+ *	LINK_PING		-							protocol version
+ *	LINK_SET_TONE	index, Hz u32, ms u16, dB	-
+ *	LINK_GET_TONE	index						index, Hz u32, ms u16, dB,
+ *												update pending
+ *	LINK_SET_OPTIONS	trim i8, mute, retrigger policy	-
+ *	LINK_GET_OPTIONS	-						trim i8, mute, retrigger policy,
+ *												update pending
+ *	LINK_SAVE_PROFILE	slot					- (once written to EEPROM)
+ *	LINK_ARM		-							-
+ *	LINK_DISARM		-							-
+ *	LINK_GET_COUNTERS -							tones u32, dropped u16,
+ *												coalesced u16, log overruns u16,
+ *												select misses u16, link errors u16
+ *	LINK_GET_STATUS	-							flags, overhead avg u16,
+ *												overhead max u16, passes u32
+ *
+ * Feed() takes one byte at a time and keeps its place between calls, so
+ * the caller reads whatever has arrived and never waits for the rest of a
+ * frame.
+ */
+
+#ifndef CommandLink_h
+#define CommandLink_h
+
+#include "Hal.h"
+
+#define LINK_SYNC			0xA5
+#define LINK_VERSION		1
+#define LINK_MAX_PAYLOAD	16
+#define LINK_MAX_FRAME		(LINK_MAX_PAYLOAD + 4)
+#define LINK_REPLY			0x80
+
+typedef enum {
+	LINK_PING			= 0x01,
+	LINK_SET_TONE		= 0x10,
+	LINK_GET_TONE		= 0x11,
+	LINK_SET_OPTIONS	= 0x12,
+	LINK_GET_OPTIONS	= 0x13,
+	LINK_SAVE_PROFILE	= 0x40,
+	LINK_ARM			= 0x20,
+	LINK_DISARM			= 0x21,
+	LINK_GET_COUNTERS	= 0x30,
+	LINK_GET_STATUS		= 0x31
+} LinkCommand;
+
+typedef enum {
+	LINK_OK,
+	LINK_BAD_COMMAND,
+	LINK_BAD_LENGTH,
+	LINK_BAD_VALUE,
+	LINK_BUSY				// an earlier update is still waiting
+} LinkStatus;
+
+// LINK_GET_STATUS flags
+#define LINK_FLAG_ENABLED	0x01		// trigger input on
+#define LINK_FLAG_ARMED		0x02		// ready for the next onset
+#define LINK_FLAG_PLAYING	0x04
+#define LINK_FLAG_PENDING	0x08		// update waiting for the next trial
+
+struct LinkFrame {
+	uint8_t		command;
+	uint8_t		length;
+	uint8_t		payload[LINK_MAX_PAYLOAD];
+};
+
+class CommandLink {
+
+public:
+
+	CommandLink ( void );
+
+	// Parse one received byte. Returns true when it completed a frame
+	// with a valid CRC, which stays in Received() until the next byte
+	bool Feed ( uint8_t b );
+
+	const LinkFrame &Received ( void ) const { return frame; }
+
+	// Inside a frame: bytes are data, not text commands
+	bool InFrame ( void ) const { return state != LINK_WAIT_SYNC; }
+
+	// Drop a partial frame, e.g. after the sender went quiet. Counted
+	void Abort ( void );
+
+	// Frame with command and payload into out (LINK_MAX_FRAME bytes).
+	// Returns the frame length
+	static uint8_t Encode ( uint8_t *out, uint8_t command,
+		const uint8_t *payload, uint8_t length );
+
+	// Reply frame for command: status, then length bytes of data
+	static uint8_t Reply ( uint8_t *out, uint8_t command, uint8_t status,
+		const uint8_t *data = 0, uint8_t length = 0 );
+
+	// Frames dropped for a bad CRC, a bad length or a timeout
+	uint16_t Errors ( void ) const { return errors; }
+
+	static uint16_t Get16 ( const uint8_t *p ) { return p[0] | (uint16_t)p[1] << 8; }
+	static uint32_t Get32 ( const uint8_t *p ) {
+		return Get16(p) | (uint32_t)Get16(p + 2) << 16;
+	}
+	static uint8_t *Put16 ( uint8_t *p, uint16_t v ) {
+		p[0] = v;
+		p[1] = v >> 8;
+		return p + 2;
+	}
+	static uint8_t *Put32 ( uint8_t *p, uint32_t v ) {
+		return Put16(Put16(p, v), v >> 16);
+	}
+
+private:
+
+	enum { LINK_WAIT_SYNC, LINK_LENGTH, LINK_COMMAND, LINK_PAYLOAD, LINK_CRC };
+
+	static uint8_t	Crc ( uint8_t crc, uint8_t b );
+
+	LinkFrame		frame;
+	uint8_t			state, count, crc;
+	uint16_t		errors;
+};
+
+#endif
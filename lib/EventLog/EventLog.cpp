@@ -0,0 +1,165 @@
+/*
+ * EventLog.cpp
+ *
+ * Deferred event logging. See EventLog.h for an overview.
+ */
+
+#include "EventLog.h"
+
+#define LOG_MASK	(LOG_CAPACITY - 1)
+
+EventLog :: EventLog ( void ) {
+	head = tail = 0;
+	overruns = reportedOverruns = 0;
+	lineLen = linePos = 0;
+}
+
+#define LOG_TICKS_PER_S		(1000000UL * HAL_TIMER_TICKS_PER_US)
+#define LOG_TIME_DIGITS		7		// 0.1 us: enough for any tick length
+
+/*
+ * Capture an event. Interrupts are held off only for the copy into the
+ * ring.
+ */
+bool EventLog :: Push ( uint8_t type, uint32_t tone, uint32_t value,
+		uint64_t time ) {
+	bool ok = false;
+
+	HalIrqState state = halIrqSave();
+	uint8_t next = (head + 1) & LOG_MASK;
+	if ( next != tail ) {
+		LogEvent &e = ring[head];
+		e.type = type;
+		e.tone = tone;
+		e.value = value;
+		e.time = time;
+		head = next;
+		ok = true;
+	}
+	else
+		overruns++;
+	halIrqRestore(state);
+	return ok;
+}
+
+/*
+ * Send the pending line and as many further lines as the output buffer
+ * has room for. Returns as soon as availableForWrite() reaches 0.
+ */
+void EventLog :: Drain ( Print &out ) {
+	for ( ;; ) {
+		if ( linePos >= lineLen && !NextLine() ) return;
+		int room = out.availableForWrite();
+		if ( room <= 0 ) return;
+		uint8_t n = lineLen - linePos;
+		if ( room < n ) n = room;
+		out.write((const uint8_t *)line + linePos, n);
+		linePos += n;
+	}
+}
+
+bool EventLog :: IsIdle ( void ) const {
+	return linePos >= lineLen && head == tail && overruns == reportedOverruns;
+}
+
+// --------------------- PRIVATE FUNCTIONS --------------------------
+
+/*
+ * Format the next record (or a pending overrun report) into line[]
+ */
+bool EventLog :: NextLine ( void ) {
+	lineLen = linePos = 0;
+
+	HalIrqState state = halIrqSave();
+	uint16_t dropped = overruns;
+	halIrqRestore(state);
+	if ( dropped != reportedOverruns ) {
+		Append("[LOG] ");
+		AppendNumber((uint16_t)(dropped - reportedOverruns));
+		Append(" event(s) dropped\n");
+		reportedOverruns = dropped;
+		return true;
+	}
+
+	if ( tail == head ) return false;
+	LogEvent e = ring[tail];		// the producer never touches ring[tail]
+	tail = (tail + 1) & LOG_MASK;
+
+	Append("[");
+	AppendTime(e.time);
+	Append(" s] Tone #");
+	AppendNumber(e.tone);
+	switch ( e.type ) {
+	case LOG_TRIGGER:
+		Append(" TRIGGER (onset +");
+		AppendNumber(e.value / HAL_TIMER_TICKS_PER_US);
+		Append(".");
+		AppendNumber(e.value % HAL_TIMER_TICKS_PER_US * 10 / HAL_TIMER_TICKS_PER_US);
+		Append(" us)\n");
+		break;
+	case LOG_TONE_START:
+		Append(" START (");
+		AppendNumber(e.value);
+		Append(" Hz)\n");
+		break;
+	case LOG_TONE_END:
+		Append(" END (duration: ");
+		AppendNumber(e.value);
+		Append(" us)\n\n");
+		break;
+	case LOG_SEQUENCE:
+		Append(" SEQUENCE (max update rate: ");
+		AppendNumber(e.value);
+		Append(" Hz)\n");
+		break;
+	case LOG_RAMP_UP:
+	case LOG_RAMP_DOWN:
+		Append(e.type == LOG_RAMP_UP ? " RAMP UP (" : " RAMP DOWN (");
+		AppendNumber(e.value >> 24);
+		Append(" updates in ");
+		AppendNumber(e.value & 0xFFFFFF);
+		Append(" us)\n");
+		break;
+	case LOG_TRIGGER_DROPPED:
+	case LOG_TRIGGER_COALESCED:
+		Append(e.type == LOG_TRIGGER_DROPPED ? " TRIGGER DROPPED (" :
+			" TRIGGER COALESCED (");
+		AppendNumber(e.value);
+		Append(" total)\n");
+		break;
+	case LOG_TONE_RESTART:
+		Append(" RESTART\n\n");
+		break;
+	default:
+		Append(" ?\n");
+		break;
+	}
+	return true;
+}
+
+void EventLog :: Append ( const char *s ) {
+	while ( *s && lineLen < LOG_LINE_MAX ) line[lineLen++] = *s++;
+}
+
+/*
+ * Seconds since boot with LOG_TIME_DIGITS decimals. Idle time only: the
+ * 64 bit division is slow on the AVR
+ */
+void EventLog :: AppendTime ( uint64_t ticks ) {
+	uint32_t seconds = ticks / LOG_TICKS_PER_S;
+	uint32_t rest = ticks - (uint64_t)seconds * LOG_TICKS_PER_S;
+	AppendNumber(seconds);
+	Append(".");
+	AppendNumber((uint64_t)rest * 10000000UL / LOG_TICKS_PER_S, LOG_TIME_DIGITS);
+}
+
+void EventLog :: AppendNumber ( uint32_t n, uint8_t minDigits ) {
+	char digits[10];
+	uint8_t count = 0;
+	do {
+		digits[count++] = '0' + n % 10;
+		n /= 10;
+	} while ( n );
+	while ( count < minDigits && count < sizeof(digits) ) digits[count++] = '0';
+	while ( count && lineLen < LOG_LINE_MAX ) line[lineLen++] = digits[--count];
+}
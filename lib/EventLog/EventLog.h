@@ -0,0 +1,79 @@
+/*
+ * EventLog.h
+ *
+ * Deferred event logging. Events are captured as small fixed-size records
+ * into a RAM ring buffer in O(1) - safe from an ISR - and are formatted
+ * and sent only from idle time in loop(). Drain() never writes more than
+ * the serial TX buffer can take, so it can not block. When the ring is
+ * full new events are dropped and counted instead of waiting.
+ *
+ * Time stamps are Timer1 ticks on the 64 bit HAL timebase (0.5 us at
+ * 16 MHz, see halTimerTicks64()) and are printed as seconds since boot
+ * with full tick resolution: [12.3456785 s].
+ */
+
+#ifndef EventLog_h
+#define EventLog_h
+
+#include "Hal.h"
+
+#define LOG_CAPACITY		16		// records, must be a power of 2
+#define LOG_LINE_MAX		72
+
+typedef enum {
+	LOG_TRIGGER,		// time = trigger ISR entry, value = ticks to the onset
+	LOG_TONE_START,		// value = frequency in Hz
+	LOG_TONE_END,		// value = measured on-time in us
+	LOG_SEQUENCE,		// value = highest sequence update rate in Hz
+	LOG_RAMP_UP,		// value = I2C updates << 24 | measured length in us
+	LOG_RAMP_DOWN,
+	LOG_TRIGGER_DROPPED,	// time = edge, value = dropped triggers so far
+	LOG_TRIGGER_COALESCED,	// value = coalesced triggers so far
+	LOG_TONE_RESTART		// tone cut short by a retrigger
+} LogEventType;
+
+struct LogEvent {
+	uint8_t		type;
+	uint32_t	tone;		// tone number
+	uint32_t	value;
+	uint64_t	time;		// Timer1 ticks (halTimerTicks64())
+};
+
+class EventLog {
+
+public:
+
+	EventLog ( void );
+
+	// Capture an event, stamped now or at a given halTimerTicks64() time.
+	// Returns false (and counts an overrun) if full
+	bool Push ( uint8_t type, uint32_t tone, uint32_t value ) {
+		return Push(type, tone, value, halTimerTicks64());
+	}
+	bool Push ( uint8_t type, uint32_t tone, uint32_t value, uint64_t time );
+
+	// Format and send as much as fits in the output buffer right now
+	void Drain ( Print &out );
+
+	// True if there is nothing left to send
+	bool IsIdle ( void ) const;
+
+	// Number of events dropped because the ring was full
+	uint16_t Overruns ( void ) const { return overruns; }
+
+private:
+
+	bool			NextLine ( void );
+	void			Append ( const char *s );
+	void			AppendNumber ( uint32_t n, uint8_t minDigits = 1 );
+	void			AppendTime ( uint64_t ticks );
+
+	LogEvent		ring[LOG_CAPACITY];
+	volatile uint8_t	head, tail;
+	volatile uint16_t	overruns;
+	uint16_t		reportedOverruns;
+	char			line[LOG_LINE_MAX];
+	uint8_t			lineLen, linePos;
+};
+
+#endif
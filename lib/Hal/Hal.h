@@ -0,0 +1,53 @@
+/*
+ * Hal.h
+ *
+ * Thin hardware abstraction for SPI, I2C, GPIO, time, interrupts, the
+ * Timer1 compare units and 64 bit timebase, the Timer2 ticker and the
+ * EEPROM. The drivers and the main.cpp state machine are written against
+ * these functions only.
+ *
+ * On the board (ARDUINO_ARCH_AVR) every call is an inline wrapper around
+ * the Arduino core or a direct register access, so there is no cost over
+ * calling the core yourself. With HAL_NATIVE (the "native" PlatformIO
+ * environment) the same calls go to recording fakes driven by a virtual
+ * CPU clock, see HalNative.h.
+ *
+ * Three flavours exist for bus access:
+ *	halSpiTransfer / halI2cWrite		- core drivers, loop() context
+ *	halSpiWriteRaw / halI2cWriteRaw		- polled registers, ISR safe
+ *	halI2cWriteAsync					- queued, drained by the TWI interrupt
+ */
+
+#ifndef Hal_h
+#define Hal_h
+
+#include <stdint.h>
+
+// Asynchronous I2C queue. A write is copied into the queue and sent by
+// the TWI interrupt; done(context, tag, status) then runs in interrupt
+// context with the Wire style status (0 = success, 2 = address NACK,
+// 3 = data NACK, 4 = other error).
+#define HAL_I2C_QUEUE_SIZE		8		// power of 2
+#define HAL_I2C_QUEUE_ROOM		(HAL_I2C_QUEUE_SIZE - 1)	// writes queued at most
+#define HAL_I2C_MAX_BYTES		3
+
+typedef void (*HalI2cDone) ( void *context, uint8_t tag, uint8_t status );
+
+#if defined(ARDUINO_ARCH_AVR)
+	#include "HalAvr.h"
+#elif defined(HAL_NATIVE)
+	#include "HalNative.h"
+#else
+	#error "Hal: no backend for this target (build for AVR or define HAL_NATIVE)"
+#endif
+
+#ifndef F_CPU
+	#define F_CPU				16000000UL
+#endif
+
+#define HAL_CYCLES_PER_US		(F_CPU / 1000000UL)
+#define HAL_TIMER_TICKS_PER_US	(F_CPU / 8000000UL)	// Timer1 runs at F_CPU / 8
+#define HAL_TICKER_CYCLES		128					// Timer2 tick: F_CPU / 128
+#define HAL_TICKER_MAX_TICKS	256
+
+#endif
@@ -0,0 +1,235 @@
+/*
+ * HalAvr.cpp
+ *
+ * Out-of-line parts of the ATmega328 HAL backend.
+ */
+
+#if defined(ARDUINO_ARCH_AVR)
+
+#include "Hal.h"
+
+// TWI status codes (TWSR & 0xF8) for master transmitter mode
+#define TW_START			0x08
+#define TW_REP_START		0x10
+#define TW_MT_SLA_ACK		0x18
+#define TW_MT_SLA_NACK		0x20
+#define TW_MT_DATA_ACK		0x28
+#define TW_MT_DATA_NACK		0x30
+
+/*
+ * Polled TWI master write. The Wire interrupt stays disabled for the
+ * duration of the transfer and is re-enabled afterwards, so this can run
+ * inside an ISR as long as no Wire transfer was interrupted.
+ */
+uint8_t halI2cWriteRaw ( uint8_t address, const uint8_t *data, uint8_t n ) {
+	uint8_t status = 0;
+
+	TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN);
+	while ( !(TWCR & _BV(TWINT)) ) ;
+	TWDR = address << 1;
+	TWCR = _BV(TWINT) | _BV(TWEN);
+	while ( !(TWCR & _BV(TWINT)) ) ;
+	if ( (TWSR & 0xF8) != TW_MT_SLA_ACK ) status = 2;	// Wire: address NACK
+
+	for ( uint8_t i = 0; i < n && !status; i++ ) {
+		TWDR = data[i];
+		TWCR = _BV(TWINT) | _BV(TWEN);
+		while ( !(TWCR & _BV(TWINT)) ) ;
+		if ( (TWSR & 0xF8) != TW_MT_DATA_ACK ) status = 3;	// data NACK
+	}
+
+	TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN);
+	while ( TWCR & _BV(TWSTO) ) ;
+#ifdef HAL_I2C_WIRE
+	TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA);	// hand the bus back to Wire
+#else
+	TWCR = _BV(TWEN);							// idle, as the queue left it
+#endif
+	return status;
+}
+
+// --------------------- Reset cause ----------------------
+
+// In .noinit: the C runtime clears .bss after .init3
+static uint8_t	resetFlags __attribute__((section(".noinit")));
+
+/*
+ * Runs from .init3, before main(). Optiboot clears MCUSR and passes its
+ * value in r2; without a bootloader MCUSR still holds it and r2 is
+ * undefined, which can only make a warm reset look like a power-on one.
+ */
+void halSaveResetFlags ( void ) __attribute__((naked, used, section(".init3")));
+void halSaveResetFlags ( void ) {
+	uint8_t passed;
+	__asm__ __volatile__ ( "mov %0, r2" : "=r" (passed) );
+	resetFlags = MCUSR | passed;
+	MCUSR = 0;
+}
+
+bool halPowerOnReset ( void ) {
+	return resetFlags & (_BV(PORF) | _BV(BORF));
+}
+
+// --------------------- Timer1 timebase ----------------------
+
+static volatile uint64_t	timerOverflows;
+
+ISR(TIMER1_OVF_vect) {
+	timerOverflows++;
+}
+
+/*
+ * Overflows at the time TCNT1 was read: an overflow that is pending but
+ * not yet counted (interrupts off) belongs to a low count.
+ */
+static uint64_t OverflowsAt ( uint16_t now ) {
+	uint64_t o = timerOverflows;
+	if ( (TIFR1 & _BV(TOV1)) && now < 0x8000 ) o++;
+	return o;
+}
+
+uint64_t halTimerTicks64 ( void ) {
+	HalIrqState state = halIrqSave();
+	uint16_t now = TCNT1;
+	uint64_t o = OverflowsAt(now);
+	halIrqRestore(state);
+	return (o << 16) | now;
+}
+
+uint64_t halTimerExtend ( uint16_t tick ) {
+	HalIrqState state = halIrqSave();
+	uint16_t now = TCNT1;
+	uint64_t o = OverflowsAt(now);
+	halIrqRestore(state);
+	if ( tick > now ) o--;			// taken before the last overflow
+	return (o << 16) | tick;
+}
+
+#ifndef HAL_I2C_WIRE
+
+// --------------------- TWI queue ----------------------
+
+#define I2C_QUEUE_MASK		(HAL_I2C_QUEUE_SIZE - 1)
+
+struct I2cCommand {
+	uint8_t		address;
+	uint8_t		n;
+	uint8_t		data[HAL_I2C_MAX_BYTES];
+	uint8_t		tag;
+	HalI2cDone	done;
+	void		*context;
+};
+
+static I2cCommand		i2cQueue[HAL_I2C_QUEUE_SIZE];
+static volatile uint8_t	i2cHead, i2cTail;	// next free, in progress
+static volatile uint8_t	i2cByte;			// next data byte of the command
+static volatile bool	i2cBusy;
+
+/*
+ * Send a START for the command at the tail, or go idle. Interrupts off.
+ */
+static void StartNext ( void ) {
+	if ( i2cTail == i2cHead ) {
+		i2cBusy = false;
+		TWCR = _BV(TWEN);
+		return;
+	}
+	i2cBusy = true;
+	i2cByte = 0;
+	TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE);
+}
+
+void halI2cBegin ( void ) {
+	PORTC |= _BV(4) | _BV(5);		// pull-ups on SDA (A4) and SCL (A5)
+	if ( !TWBR ) halI2cSetClock(100000);
+	TWCR = _BV(TWEN);
+}
+
+bool halI2cWriteAsync ( uint8_t address, const uint8_t *data, uint8_t n,
+		HalI2cDone done, void *context, uint8_t tag ) {
+	if ( n > HAL_I2C_MAX_BYTES ) return false;
+
+	HalIrqState state = halIrqSave();
+	uint8_t next = (i2cHead + 1) & I2C_QUEUE_MASK;
+	if ( next == i2cTail ) {
+		halIrqRestore(state);
+		return false;
+	}
+	I2cCommand &c = i2cQueue[i2cHead];
+	c.address = address;
+	c.n = n;
+	for ( uint8_t i = 0; i < n; i++ ) c.data[i] = data[i];
+	c.tag = tag;
+	c.done = done;
+	c.context = context;
+	i2cHead = next;
+	if ( !i2cBusy ) StartNext();
+	halIrqRestore(state);
+	return true;
+}
+
+uint8_t halI2cPending ( void ) {
+	return (i2cHead - i2cTail) & I2C_QUEUE_MASK;
+}
+
+void halI2cFlush ( void ) {
+	while ( halI2cPending() ) ;
+}
+
+static void StoreStatus ( void *context, uint8_t tag, uint8_t status ) {
+	*(volatile uint8_t *)context = status;
+}
+
+uint8_t halI2cWrite ( uint8_t address, const uint8_t *data, uint8_t n ) {
+	volatile uint8_t status = 0xFF;
+	while ( !halI2cWriteAsync(address, data, n, StoreStatus, (void *)&status) ) {
+		if ( n > HAL_I2C_MAX_BYTES ) return 1;		// Wire: data too long
+	}
+	while ( status == 0xFF ) ;
+	return status;
+}
+
+/*
+ * One TWINT per START, address and data byte. After the last byte (or a
+ * NACK) the STOP is sent and the next queued command started.
+ */
+ISR(TWI_vect) {
+	I2cCommand &c = i2cQueue[i2cTail];
+	uint8_t status;
+
+	switch ( TWSR & 0xF8 ) {
+	case TW_START:
+	case TW_REP_START:
+		TWDR = c.address << 1;
+		TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE);
+		return;
+	case TW_MT_SLA_ACK:
+	case TW_MT_DATA_ACK:
+		if ( i2cByte < c.n ) {
+			TWDR = c.data[i2cByte++];
+			TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE);
+			return;
+		}
+		status = 0;
+		break;
+	case TW_MT_SLA_NACK:
+		status = 2;
+		break;
+	case TW_MT_DATA_NACK:
+		status = 3;
+		break;
+	default:						// arbitration lost, bus error
+		status = 4;
+		break;
+	}
+
+	TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN);
+	while ( TWCR & _BV(TWSTO) ) ;	// half an SCL period
+	i2cTail = (i2cTail + 1) & I2C_QUEUE_MASK;
+	if ( c.done ) c.done(c.context, c.tag, status);
+	StartNext();
+}
+
+#endif
+
+#endif
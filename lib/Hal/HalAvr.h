@@ -0,0 +1,301 @@
+/*
+ * HalAvr.h
+ *
+ * ATmega328 backend of the HAL. Everything except the TWI engine is
+ * inline, so the HAL compiles down to the same code as calling the
+ * Arduino core or touching the registers directly.
+ *
+ * I2C goes through the HAL's own interrupt driven TWI engine (HalAvr.cpp),
+ * which owns TWI_vect, so the Wire library must not be linked. Build with
+ * HAL_I2C_WIRE to use Wire instead; the queued writes then complete
+ * before halI2cWriteAsync() returns.
+ */
+
+#ifndef HalAvr_h
+#define HalAvr_h
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <avr/eeprom.h>
+#include "digitalWriteFast.h"
+#ifdef HAL_I2C_WIRE
+	#include <Wire.h>
+#endif
+
+struct HalPin {
+	volatile uint8_t	*port;
+	uint8_t				mask;
+};
+
+typedef uint8_t HalIrqState;
+
+// Interrupt vectors used by the firmware
+#define HAL_TRIGGER_ISR			ISR(INT1_vect)
+#define HAL_TIMER_COMPARE_ISR	ISR(TIMER1_COMPA_vect)
+#define HAL_TIMER_COMPARE_B_ISR	ISR(TIMER1_COMPB_vect)
+#define HAL_TICKER_ISR			ISR(TIMER2_COMPA_vect)
+
+// --------------------- Time ----------------------
+
+inline uint32_t halMillis ( void ) { return millis(); }
+inline uint32_t halMicros ( void ) { return micros(); }
+inline void halDelay ( uint32_t ms ) { delay(ms); }
+
+// True after a power-on or brown-out reset, when the other chips on the
+// supply may still be coming up (MCUSR saved at reset, see HalAvr.cpp)
+bool halPowerOnReset ( void );
+
+// --------------------- Interrupts ----------------------
+
+inline HalIrqState halIrqSave ( void ) {
+	HalIrqState state = SREG;
+	cli();
+	return state;
+}
+
+inline void halIrqRestore ( HalIrqState state ) { SREG = state; }
+
+// INT1 (pin 3), rising edge. Edges seen before this call are discarded.
+inline void halTriggerEnable ( void ) {
+	EICRA = (EICRA & ~(_BV(ISC11) | _BV(ISC10))) | _BV(ISC11) | _BV(ISC10);
+	EIFR = _BV(INTF1);
+	EIMSK |= _BV(INT1);
+}
+
+// Ignore the trigger pin until the next halTriggerEnable()
+inline void halTriggerDisable ( void ) { EIMSK &= ~_BV(INT1); }
+
+// --------------------- GPIO ----------------------
+
+// All eight lines of the trigger pin's port (PD0 - PD7 = pins 0 - 7) in
+// one read, e.g. stimulus select lines next to the INT1 edge
+inline uint8_t halTriggerPort ( void ) { return PIND; }
+
+inline void halPinMode ( uint8_t pin, uint8_t mode ) { pinMode(pin, mode); }
+inline void halDigitalWrite ( uint8_t pin, uint8_t val ) { digitalWrite(pin, val); }
+
+// Resolved port / mask for fast writes. Read-modify-write, so callers
+// must not race an ISR that writes the same port.
+inline HalPin halPin ( uint8_t pin ) {
+	HalPin p;
+	p.port = portOutputRegister(digitalPinToPort(pin));
+	p.mask = digitalPinToBitMask(pin);
+	return p;
+}
+
+inline void halPinLow ( const HalPin &p ) { *p.port &= ~p.mask; }
+inline void halPinHigh ( const HalPin &p ) { *p.port |= p.mask; }
+
+// Add a pin to p, so halPinLow() / halPinHigh() switch all of them in
+// the same port write. Returns false (p unchanged) for another port
+inline bool halPinAdd ( HalPin &p, uint8_t pin ) {
+	HalPin q = halPin(pin);
+	if ( q.port != p.port ) return false;
+	p.mask |= q.mask;
+	return true;
+}
+
+// A pin fixed at compile time: a single SBI / CBI, which is also atomic
+template < uint8_t Pin > inline void halPinLowFast ( void ) {
+	digitalWriteFast2(Pin, LOW);
+}
+template < uint8_t Pin > inline void halPinHighFast ( void ) {
+	digitalWriteFast2(Pin, HIGH);
+}
+
+// --------------------- SPI ----------------------
+
+inline void halSpiBegin ( void ) { SPI.begin(); }
+inline void halSpiMode2 ( void ) { SPI.setDataMode(SPI_MODE2); }
+
+#define HAL_SPI_MODE2			SPI_MODE2
+
+// Claim the bus for a burst: clock (rounded down to F_CPU / 2^n), MSB
+// first, given mode. Other SPI users set their own settings in between.
+inline void halSpiBeginTransaction ( uint32_t hz, uint8_t mode ) {
+	SPI.beginTransaction(SPISettings(hz, MSBFIRST, mode));
+}
+inline void halSpiEndTransaction ( void ) { SPI.endTransaction(); }
+inline uint8_t halSpiTransfer ( uint8_t b ) { return SPI.transfer(b); }
+
+// Polled SPDR write. SPI must already be configured.
+inline void halSpiWriteRaw ( uint8_t b ) {
+	SPDR = b;
+	while ( !(SPSR & _BV(SPIF)) ) ;
+}
+
+// CPU cycles per byte at the current SPI clock
+inline uint16_t halSpiByteCycles ( void ) {
+	static const uint8_t spiDiv[4] = { 4, 16, 64, 128 };
+	uint16_t div = spiDiv[SPCR & (_BV(SPR1) | _BV(SPR0))];
+	if ( SPSR & _BV(SPI2X) ) div >>= 1;
+	return 8 * div;
+}
+
+// --------------------- I2C ----------------------
+
+#ifdef HAL_I2C_WIRE
+
+inline void halI2cBegin ( void ) { Wire.begin(); }
+inline void halI2cSetClock ( uint32_t hz ) { Wire.setClock(hz); }
+
+// Blocking write through Wire. Returns the Wire status (0 = success)
+inline uint8_t halI2cWrite ( uint8_t address, const uint8_t *data, uint8_t n ) {
+	Wire.beginTransmission(address);
+	Wire.write(data, n);
+	return Wire.endTransmission();
+}
+
+inline bool halI2cWriteAsync ( uint8_t address, const uint8_t *data, uint8_t n,
+		HalI2cDone done = 0, void *context = 0, uint8_t tag = 0 ) {
+	uint8_t status = halI2cWrite(address, data, n);
+	if ( done ) done(context, tag, status);
+	return true;
+}
+
+inline uint8_t halI2cPending ( void ) { return 0; }
+inline void halI2cFlush ( void ) { }
+
+#else
+
+// Enable the TWI (100 kHz unless set) with the internal pull-ups on
+// SDA / SCL, like Wire.begin()
+void halI2cBegin ( void );
+
+inline void halI2cSetClock ( uint32_t hz ) {
+	TWSR &= ~(_BV(TWPS1) | _BV(TWPS0));
+	TWBR = ((F_CPU / hz) - 16) / 2;
+}
+
+// Blocking write: queued behind pending async writes, then waited for.
+// Needs interrupts enabled. Returns the status (0 = success)
+uint8_t halI2cWrite ( uint8_t address, const uint8_t *data, uint8_t n );
+
+// Queue a write of up to HAL_I2C_MAX_BYTES and return at once. Returns
+// false (nothing queued) when the queue is full or n is too large
+bool halI2cWriteAsync ( uint8_t address, const uint8_t *data, uint8_t n,
+	HalI2cDone done = 0, void *context = 0, uint8_t tag = 0 );
+
+// Writes queued or in progress
+uint8_t halI2cPending ( void );
+
+// Wait until the queue is empty. Needs interrupts enabled
+void halI2cFlush ( void );
+
+#endif
+
+// Polled TWI write for ISR context. The queue must be empty (see
+// halI2cFlush) and no Wire transfer may be in progress.
+// Returns 0 on success, like halI2cWrite.
+uint8_t halI2cWriteRaw ( uint8_t address, const uint8_t *data, uint8_t n );
+
+// CPU cycles per SCL period: 16 + 2 * TWBR * 4^TWPS
+inline uint16_t halI2cBitCycles ( void ) {
+	return 16 + 2 * (uint16_t)TWBR * (1 << (2 * (TWSR & 0x03)));
+}
+
+// --------------------- Timer1 ----------------------
+
+// Free running 16 bit counter at F_CPU / 8. Takes Timer1 from the core,
+// so analogWrite() on pins 9 and 10 is not available. The overflow
+// interrupt (HalAvr.cpp) extends it to the 64 bit timebase below.
+inline void halTimerBegin ( void ) {
+	uint8_t oldSREG = SREG;
+	cli();
+	TCCR1A = 0;
+	TCCR1B = _BV(CS11);
+	TIFR1 = _BV(OCF1A) | _BV(OCF1B) | _BV(TOV1) | _BV(ICF1);
+	TIMSK1 = _BV(TOIE1);
+	SREG = oldSREG;
+}
+
+inline uint16_t halTimerNow ( void ) { return TCNT1; }
+
+// Timer1 ticks since halTimerBegin() as a 64 bit count (0.5 us at 16 MHz,
+// no rollover in practice). Safe from an ISR
+uint64_t halTimerTicks64 ( void );
+
+// Extend a halTimerNow() value taken less than one timer period ago
+// (32 ms), e.g. at ISR entry, to the 64 bit timebase. Safe from an ISR
+uint64_t halTimerExtend ( uint16_t tick );
+inline uint16_t halTimerCompare ( void ) { return OCR1A; }
+inline void halTimerSetCompare ( uint16_t ticks ) { OCR1A = ticks; }
+
+// Enabling discards a match that is already pending
+inline void halTimerCompareEnable ( bool enable ) {
+	if ( enable ) {
+		TIFR1 = _BV(OCF1A);
+		TIMSK1 |= _BV(OCIE1A);
+	}
+	else
+		TIMSK1 &= ~_BV(OCIE1A);
+}
+
+// Second compare unit (OCR1B) on the same counter
+inline uint16_t halTimerCompareB ( void ) { return OCR1B; }
+inline void halTimerSetCompareB ( uint16_t ticks ) { OCR1B = ticks; }
+
+inline void halTimerCompareBEnable ( bool enable ) {
+	if ( enable ) {
+		TIFR1 = _BV(OCF1B);
+		TIMSK1 |= _BV(OCIE1B);
+	}
+	else
+		TIMSK1 &= ~_BV(OCIE1B);
+}
+
+// --------------------- Timer2 ----------------------
+
+// Periodic HAL_TICKER_ISR every ticks * HAL_TICKER_CYCLES cycles (1 - 256
+// ticks, 8 us each at 16 MHz), first one a full period from now. CTC
+// mode, so the period does not drift with ISR latency. Takes Timer2 from
+// the core, so tone() is not available.
+inline void halTickerStart ( uint16_t ticks ) {
+	uint8_t oldSREG = SREG;
+	cli();
+	TCCR2B = 0;
+	TCCR2A = _BV(WGM21);
+	TCNT2 = 0;
+	OCR2A = ticks - 1;
+	TIFR2 = _BV(OCF2A);
+	TIMSK2 = _BV(OCIE2A);
+	TCCR2B = _BV(CS22) | _BV(CS20);		// F_CPU / 128
+	SREG = oldSREG;
+}
+
+inline void halTickerStop ( void ) {
+	TIMSK2 = 0;
+	TCCR2B = 0;
+}
+
+// --------------------- Flash ----------------------
+
+// Constant tables in program memory, copied out with halFlashRead()
+#define HAL_FLASH				PROGMEM
+
+inline void halFlashRead ( void *dst, const void *src, size_t n ) {
+	memcpy_P(dst, src, n);
+}
+
+// --------------------- EEPROM ----------------------
+
+#define HAL_EEPROM_SIZE			(E2END + 1)
+
+inline uint8_t halEepromRead ( uint16_t address ) {
+	return eeprom_read_byte((const uint8_t *)address);
+}
+
+inline void halEepromReadBlock ( void *dst, uint16_t address, size_t n ) {
+	eeprom_read_block(dst, (const void *)address, n);
+}
+
+// No write in progress: halEepromWrite() returns at once
+inline bool halEepromReady ( void ) { return eeprom_is_ready(); }
+
+// Start an erase + write of one cell (~3.4 ms in the background). Spins
+// while an earlier write is still in progress
+inline void halEepromWrite ( uint16_t address, uint8_t b ) {
+	eeprom_write_byte((uint8_t *)address, b);
+}
+
+#endif
@@ -0,0 +1,635 @@
+/*
+ * HalNative.cpp
+ *
+ * Recording fakes and virtual clock for the host HAL backend. See
+ * HalNative.h for the model.
+ */
+
+#if defined(HAL_NATIVE)
+
+#include <stdio.h>
+#include <string.h>
+#include "Hal.h"
+
+// Modelled costs in CPU cycles
+#define COST_DIGITAL_WRITE		70		// core digitalWrite(), ~4.4 us
+#define COST_PIN_FAST			2		// SBI / CBI
+#define COST_SPI_OVERHEAD		4		// SPDR load + SPIF polling exit
+#define COST_SPI_MODE			8
+#define COST_SPI_TRANSACTION	16		// SPCR / SPSR writes + SREG save
+#define COST_WIRE_OVERHEAD		160		// Wire buffer handling + twi_writeTo
+#define COST_TWI_RAW_OVERHEAD	24
+#define COST_I2C_QUEUE			40		// copy into the queue + START
+#define COST_ISR_ENTRY			20		// response + vector JMP + prologue
+#define COST_SERIAL_WRITE		30
+#define COST_EEPROM_READ		8		// EEAR / EERE, CPU halted 4 cycles
+#define EEPROM_WRITE_CYCLES		(3400UL * HAL_CYCLES_PER_US)
+
+#define SERIAL_TX_ROOM			63		// HardwareSerial: SERIAL_TX_BUFFER_SIZE - 1
+
+// Weak, so programs without the firmware vectors still link
+void halTriggerVector ( void ) __attribute__((weak));
+void halTimerCompareVector ( void ) __attribute__((weak));
+void halTimerCompareBVector ( void ) __attribute__((weak));
+void halTickerVector ( void ) __attribute__((weak));
+
+HalSerial Serial;
+
+static uint64_t		cycles;
+static bool			irqOn, inIsr;
+static bool			powerOnReset;
+static uint8_t		pinLevel[32];
+static std::vector<HalBusEvent>	busLog;
+
+static uint16_t		spiByteCycles;
+static uint16_t		i2cBitCycles;
+static bool			i2cNack;
+
+struct AsyncI2c {
+	uint64_t	end;				// cycle the STOP completes on
+	uint8_t		address, n, tag;
+	uint8_t		data[HAL_I2C_MAX_BYTES];
+	HalI2cDone	done;
+	void		*context;
+};
+static std::vector<AsyncI2c>	i2cQueue;
+
+static bool			triggerEnabled;
+static std::vector<uint64_t>	triggerEdges;	// halFakeTriggerAt(), in order
+
+// Compare unit A (index 0) and B (index 1)
+static bool			timerRunning, compareEnabled[2];
+static uint64_t		timerBase, checkedTick[2];
+static uint16_t		compare[2];
+
+// EEPROM, blank until written
+static uint8_t		eeprom[HAL_EEPROM_SIZE];
+static bool			eepromBlank = true;
+static uint64_t		eepromBusyUntil;
+
+// Timer2 ticker
+static bool			tickerOn;
+static uint64_t		tickerNext, tickerPeriod;	// cycles
+
+static std::string	serialOut, serialIn;
+static bool			serialEcho;
+static uint32_t		serialByteCycles;
+static uint32_t		txQueued;
+static uint64_t		txUpdated;
+
+static void Spend ( uint64_t n );
+static void I2cComplete ( void );
+
+static void Record ( uint8_t bus, uint8_t address, uint8_t data, uint8_t status ) {
+	HalBusEvent e;
+	e.cycle = cycles;
+	e.bus = bus;
+	e.address = address;
+	e.data = data;
+	e.status = status;
+	e.fromIsr = inIsr;
+	busLog.push_back(e);
+}
+
+static uint64_t TimerTick ( void ) {
+	return (cycles - timerBase) / 8;
+}
+
+static void RunIsr ( void (*vector)(void) ) {
+	if ( !vector ) return;
+	bool wasOn = irqOn, wasIn = inIsr;
+	irqOn = false;
+	inIsr = true;
+	Spend(COST_ISR_ENTRY);
+	vector();
+	inIsr = wasIn;
+	irqOn = wasOn;
+}
+
+/*
+ * Move the clock to target, running every scheduled trigger edge, Timer1
+ * compare match, Timer2 tick and I2C completion on the way, in time
+ * order, while interrupts are enabled. Matches and edges due while
+ * interrupts were off fire as soon as they are back on, as on the board.
+ */
+static void RunUntil ( uint64_t target ) {
+	while ( irqOn && !inIsr ) {
+		int unit = -1;
+		uint64_t at = 0;
+		for ( int i = 0; timerRunning && i < 2; i++ ) {	// A wins a tie, as on the board
+			if ( !compareEnabled[i] ) continue;
+			uint64_t first = checkedTick[i] + 1;
+			uint64_t n = timerBase + 8 * (first + (uint16_t)(compare[i] - (uint16_t)first));
+			if ( unit < 0 || n < at ) {
+				unit = i;
+				at = n;
+			}
+		}
+		if ( tickerOn && (unit < 0 || tickerNext < at) ) {	// lower priority
+			unit = 2;
+			at = tickerNext;
+		}
+		if ( !i2cQueue.empty() && (unit < 0 || i2cQueue.front().end < at) ) {
+			unit = 3;
+			at = i2cQueue.front().end;
+		}
+		if ( !triggerEdges.empty() && (unit < 0 || triggerEdges.front() <= at) ) {
+			unit = 4;									// INT1 first
+			at = triggerEdges.front();
+		}
+		if ( unit < 0 || at > target ) break;
+		if ( at > cycles ) cycles = at;
+		if ( unit == 4 ) {
+			while ( !triggerEdges.empty() && triggerEdges.front() <= cycles )
+				triggerEdges.erase(triggerEdges.begin());	// one INT1 flag
+			if ( triggerEnabled ) RunIsr(halTriggerVector);
+		}
+		else if ( unit == 3 ) I2cComplete();
+		else if ( unit == 2 ) {
+			do tickerNext += tickerPeriod;		// one flag for missed periods
+			while ( tickerNext <= cycles );
+			RunIsr(halTickerVector);
+		}
+		else {
+			checkedTick[unit] = (at - timerBase) / 8;
+			RunIsr(unit == 0 ? halTimerCompareVector : halTimerCompareBVector);
+		}
+	}
+	if ( target > cycles ) cycles = target;
+}
+
+
+static void Spend ( uint64_t n ) {
+	if ( irqOn && !inIsr ) RunUntil(cycles + n);
+	else cycles += n;
+	I2cComplete();
+}
+
+static void SerialUpdate ( void ) {
+	uint64_t drained = (cycles - txUpdated) / serialByteCycles;
+	if ( drained >= txQueued ) {
+		txQueued = 0;
+		txUpdated = cycles;
+	}
+	else {
+		txQueued -= drained;
+		txUpdated += drained * serialByteCycles;
+	}
+}
+
+// --------------------- Time ----------------------
+
+uint32_t halMillis ( void ) { return cycles / (F_CPU / 1000UL); }
+uint32_t halMicros ( void ) { return cycles / HAL_CYCLES_PER_US; }
+void halDelay ( uint32_t ms ) { Spend((uint64_t)ms * (F_CPU / 1000UL)); }
+bool halPowerOnReset ( void ) { return powerOnReset; }
+
+// --------------------- Interrupts ----------------------
+
+HalIrqState halIrqSave ( void ) {
+	HalIrqState state = irqOn;
+	irqOn = false;
+	return state;
+}
+
+void halIrqRestore ( HalIrqState state ) {
+	irqOn = state;
+	if ( irqOn && !inIsr ) RunUntil(cycles);
+}
+
+// Enabling clears the INT1 flag, so an edge latched before is dropped
+void halTriggerEnable ( void ) {
+	while ( !triggerEdges.empty() && triggerEdges.front() <= cycles )
+		triggerEdges.erase(triggerEdges.begin());
+	triggerEnabled = true;
+}
+void halTriggerDisable ( void ) { triggerEnabled = false; }
+
+// --------------------- GPIO ----------------------
+
+uint8_t halTriggerPort ( void ) {
+	uint8_t port = 0;
+	for ( uint8_t i = 0; i < 8; i++ )
+		if ( pinLevel[i] ) port |= 1 << i;
+	return port;
+}
+
+void halPinMode ( uint8_t pin, uint8_t mode ) { (void)pin; (void)mode; }
+
+void halDigitalWrite ( uint8_t pin, uint8_t val ) {
+	Spend(COST_DIGITAL_WRITE);
+	pinLevel[pin & 31] = val ? HIGH : LOW;
+	Record(HAL_BUS_GPIO, pin, pinLevel[pin & 31], 0);
+}
+
+HalPin halPin ( uint8_t pin ) {
+	HalPin p;
+	p.port = pin < 8 ? 0 : pin < 14 ? 1 : 2;
+	p.pins = 1UL << (pin & 31);
+	return p;
+}
+
+// One port write: every pin changes on the same cycle
+static void PinsWrite ( const HalPin &p, uint8_t level ) {
+	Spend(COST_PIN_FAST);
+	for ( uint8_t pin = 0; pin < 32; pin++ ) {
+		if ( !(p.pins & 1UL << pin) ) continue;
+		pinLevel[pin] = level;
+		Record(HAL_BUS_GPIO, pin, level, 0);
+	}
+}
+
+void halPinLow ( const HalPin &p ) { PinsWrite(p, LOW); }
+void halPinHigh ( const HalPin &p ) { PinsWrite(p, HIGH); }
+
+bool halPinAdd ( HalPin &p, uint8_t pin ) {
+	HalPin q = halPin(pin);
+	if ( q.port != p.port ) return false;
+	p.pins |= q.pins;
+	return true;
+}
+
+// --------------------- SPI ----------------------
+
+void halSpiBegin ( void ) { spiByteCycles = 32; }		// SPI.begin(): F_CPU / 4
+void halSpiMode2 ( void ) { Spend(COST_SPI_MODE); }
+
+// SPISettings picks the fastest divider (2 - 128) not above hz
+void halSpiBeginTransaction ( uint32_t hz, uint8_t mode ) {
+	(void)mode;
+	uint16_t div = 2;
+	while ( div < 128 && F_CPU / div > hz ) div <<= 1;
+	spiByteCycles = 8 * div;
+	Spend(COST_SPI_TRANSACTION);
+}
+
+void halSpiEndTransaction ( void ) { Spend(COST_SPI_MODE); }
+
+uint8_t halSpiTransfer ( uint8_t b ) {
+	Spend(spiByteCycles + COST_SPI_OVERHEAD);
+	Record(HAL_BUS_SPI, 0, b, 0);
+	return 0;
+}
+
+void halSpiWriteRaw ( uint8_t b ) {
+	Spend(spiByteCycles + COST_SPI_OVERHEAD);
+	Record(HAL_BUS_SPI, 0, b, 0);
+}
+
+uint16_t halSpiByteCycles ( void ) { return spiByteCycles; }
+
+// --------------------- I2C ----------------------
+
+void halI2cBegin ( void ) { }
+void halI2cSetClock ( uint32_t hz ) { i2cBitCycles = F_CPU / hz; }
+
+static uint8_t I2cTransfer ( uint8_t address, const uint8_t *data, uint8_t n,
+		uint16_t overhead ) {
+	uint8_t status = i2cNack ? 2 : 0;
+	// START + SLA+W + 9 bits per byte + STOP
+	uint8_t bits = 2 + 9 * (1 + (status ? 0 : n));
+	Spend(overhead + (uint32_t)bits * i2cBitCycles);
+	if ( status ) Record(HAL_BUS_I2C, address, 0, status);
+	for ( uint8_t i = 0; i < n && !status; i++ )
+		Record(HAL_BUS_I2C, address, data[i], 0);
+	return status;
+}
+
+uint8_t halI2cWrite ( uint8_t address, const uint8_t *data, uint8_t n ) {
+	halI2cFlush();
+	return I2cTransfer(address, data, n, COST_WIRE_OVERHEAD);
+}
+
+bool halI2cWriteAsync ( uint8_t address, const uint8_t *data, uint8_t n,
+		HalI2cDone done, void *context, uint8_t tag ) {
+	if ( n > HAL_I2C_MAX_BYTES || i2cQueue.size() >= HAL_I2C_QUEUE_ROOM )
+		return false;
+	Spend(COST_I2C_QUEUE);
+
+	AsyncI2c c;
+	uint64_t start = i2cQueue.empty() ? cycles : i2cQueue.back().end;
+	uint8_t bits = 2 + 9 * (1 + (i2cNack ? 0 : n));
+	c.end = start + (uint32_t)bits * i2cBitCycles;
+	c.address = address;
+	c.n = n;
+	c.tag = tag;
+	for ( uint8_t i = 0; i < n; i++ ) c.data[i] = data[i];
+	c.done = done;
+	c.context = context;
+	i2cQueue.push_back(c);
+	return true;
+}
+
+uint8_t halI2cPending ( void ) { return i2cQueue.size(); }
+
+void halI2cFlush ( void ) {
+	while ( !i2cQueue.empty() ) Spend(i2cQueue.front().end - cycles + 1);
+}
+
+/*
+ * Record and complete the queued writes that finished by now, as the TWI
+ * interrupt would. Held off while interrupts are disabled.
+ */
+static void I2cComplete ( void ) {
+	while ( !i2cQueue.empty() && i2cQueue.front().end <= cycles &&
+			irqOn && !inIsr ) {
+		AsyncI2c c = i2cQueue.front();
+		i2cQueue.erase(i2cQueue.begin());
+		uint8_t status = i2cNack ? 2 : 0;
+
+		uint64_t now = cycles;
+		cycles = c.end;
+		inIsr = true;
+		irqOn = false;
+		if ( status ) Record(HAL_BUS_I2C, c.address, 0, status);
+		for ( uint8_t i = 0; i < c.n && !status; i++ )
+			Record(HAL_BUS_I2C, c.address, c.data[i], 0);
+		cycles = now;
+		Spend(COST_ISR_ENTRY);
+		if ( c.done ) c.done(c.context, c.tag, status);
+		irqOn = true;
+		inIsr = false;
+	}
+}
+
+uint8_t halI2cWriteRaw ( uint8_t address, const uint8_t *data, uint8_t n ) {
+	return I2cTransfer(address, data, n, COST_TWI_RAW_OVERHEAD);
+}
+
+uint16_t halI2cBitCycles ( void ) { return i2cBitCycles; }
+
+// --------------------- Timer1 ----------------------
+
+void halTimerBegin ( void ) {
+	timerRunning = true;
+	compareEnabled[0] = compareEnabled[1] = false;
+	timerBase = cycles;
+	checkedTick[0] = checkedTick[1] = 0;
+}
+
+uint16_t halTimerNow ( void ) { return (uint16_t)TimerTick(); }
+
+uint64_t halTimerTicks64 ( void ) { return timerRunning ? TimerTick() : 0; }
+
+uint64_t halTimerExtend ( uint16_t tick ) {
+	uint64_t now = halTimerTicks64();
+	return now - (uint16_t)((uint16_t)now - tick);
+}
+uint16_t halTimerCompare ( void ) { return compare[0]; }
+
+void halTimerSetCompare ( uint16_t ticks ) {
+	compare[0] = ticks;
+	checkedTick[0] = TimerTick();	// a write blocks a match on this tick
+}
+
+void halTimerCompareEnable ( bool enable ) {
+	compareEnabled[0] = enable;
+	if ( enable ) checkedTick[0] = TimerTick();	// discard pending match
+}
+
+uint16_t halTimerCompareB ( void ) { return compare[1]; }
+
+void halTimerSetCompareB ( uint16_t ticks ) {
+	compare[1] = ticks;
+	checkedTick[1] = TimerTick();
+}
+
+void halTimerCompareBEnable ( bool enable ) {
+	compareEnabled[1] = enable;
+	if ( enable ) checkedTick[1] = TimerTick();
+}
+
+// --------------------- Timer2 ----------------------
+
+void halTickerStart ( uint16_t ticks ) {
+	tickerPeriod = (uint64_t)ticks * HAL_TICKER_CYCLES;
+	tickerNext = cycles + tickerPeriod;
+	tickerOn = true;
+}
+
+void halTickerStop ( void ) { tickerOn = false; }
+
+// --------------------- Flash ----------------------
+
+void halFlashRead ( void *dst, const void *src, size_t n ) {
+	memcpy(dst, src, n);
+}
+
+// --------------------- EEPROM ----------------------
+
+static void EepromInit ( void ) {
+	if ( eepromBlank ) memset(eeprom, 0xFF, sizeof(eeprom));
+	eepromBlank = false;
+}
+
+uint8_t halEepromRead ( uint16_t address ) {
+	EepromInit();
+	Spend(COST_EEPROM_READ);
+	return eeprom[address % HAL_EEPROM_SIZE];
+}
+
+void halEepromReadBlock ( void *dst, uint16_t address, size_t n ) {
+	uint8_t *d = (uint8_t *)dst;
+	for ( size_t i = 0; i < n; i++ ) d[i] = halEepromRead(address + i);
+}
+
+bool halEepromReady ( void ) { return cycles >= eepromBusyUntil; }
+
+void halEepromWrite ( uint16_t address, uint8_t b ) {
+	EepromInit();
+	if ( !halEepromReady() ) Spend(eepromBusyUntil - cycles);
+	eeprom[address % HAL_EEPROM_SIZE] = b;
+	eepromBusyUntil = cycles + EEPROM_WRITE_CYCLES;
+}
+
+// --------------------- Serial ----------------------
+
+size_t Print :: write ( const uint8_t *buffer, size_t size ) {
+	size_t n = 0;
+	while ( size-- ) n += write(*buffer++);
+	return n;
+}
+
+size_t Print :: print ( const char *s ) {
+	size_t n = 0;
+	while ( *s ) n += write((uint8_t)*s++);
+	return n;
+}
+
+size_t Print :: print ( char c ) { return write((uint8_t)c); }
+
+size_t Print :: print ( long n ) {
+	if ( n < 0 ) return print('-') + print((unsigned long)-n);
+	return print((unsigned long)n);
+}
+
+size_t Print :: print ( unsigned long n ) {
+	char buf[12];
+	char *p = buf + sizeof(buf) - 1;
+	*p = 0;
+	do {
+		*--p = '0' + n % 10;
+		n /= 10;
+	} while ( n );
+	return print(p);
+}
+
+void HalSerial :: begin ( unsigned long baud ) {
+	serialByteCycles = F_CPU * 10 / baud;
+	txQueued = 0;
+	txUpdated = cycles;
+}
+
+size_t HalSerial :: write ( uint8_t b ) {
+	SerialUpdate();
+	if ( txQueued >= SERIAL_TX_ROOM ) {		// HardwareSerial spins here
+		Spend(txUpdated + serialByteCycles - cycles);
+		SerialUpdate();
+	}
+	Spend(COST_SERIAL_WRITE);
+	txQueued++;
+	serialOut += (char)b;
+	if ( serialEcho ) putchar(b);
+	return 1;
+}
+
+int HalSerial :: availableForWrite ( void ) {
+	SerialUpdate();
+	return SERIAL_TX_ROOM - txQueued;
+}
+
+int HalSerial :: available ( void ) {
+	return serialIn.size();
+}
+
+int HalSerial :: read ( void ) {
+	if ( serialIn.empty() ) return -1;
+	uint8_t b = serialIn[0];
+	serialIn.erase(0, 1);
+	return b;
+}
+
+// --------------------- Fake control ----------------------
+
+void halFakeReset ( void ) {
+	cycles = 0;
+	powerOnReset = false;
+	irqOn = true;
+	inIsr = false;
+	for ( uint8_t i = 0; i < sizeof(pinLevel); i++ ) pinLevel[i] = LOW;
+	busLog.clear();
+	spiByteCycles = 32;
+	i2cBitCycles = F_CPU / 100000UL;		// Wire default: 100 kHz
+	i2cNack = false;
+	i2cQueue.clear();
+	triggerEnabled = false;
+	triggerEdges.clear();
+	timerRunning = false;
+	compareEnabled[0] = compareEnabled[1] = false;
+	timerBase = checkedTick[0] = checkedTick[1] = 0;
+	compare[0] = compare[1] = 0;
+	tickerOn = false;
+	tickerNext = tickerPeriod = 0;
+	eepromBusyUntil = 0;
+	serialOut.clear();
+	serialIn.clear();
+	serialByteCycles = F_CPU * 10 / 115200UL;
+	txQueued = 0;
+	txUpdated = 0;
+}
+
+void halFakePowerOn ( void ) { powerOnReset = true; }
+
+uint64_t halFakeCycles ( void ) { return cycles; }
+
+void halFakeAdvance ( uint64_t n ) { Spend(n); }
+
+void halFakeAdvanceMicros ( uint32_t us ) {
+	Spend((uint64_t)us * HAL_CYCLES_PER_US);
+}
+
+void halFakeTrigger ( void ) {
+	if ( triggerEnabled ) RunIsr(halTriggerVector);
+}
+
+void halFakeTriggerAt ( uint64_t cycle ) {
+	size_t i = triggerEdges.size();
+	while ( i > 0 && triggerEdges[i - 1] > cycle ) i--;
+	triggerEdges.insert(triggerEdges.begin() + i, cycle);
+}
+
+bool halFakeInIsr ( void ) { return inIsr; }
+
+const std::vector<HalBusEvent> &halFakeBusLog ( void ) { return busLog; }
+void halFakeClearBusLog ( void ) { busLog.clear(); }
+
+/*
+ * Pair up the SPI bytes sent inside each low period of a GPIO (FSYNC)
+ */
+std::vector<uint16_t> halFakeSpiWords ( void ) {
+	std::vector<uint16_t> words;
+	std::vector<uint8_t> frame;
+	for ( size_t i = 0; i < busLog.size(); i++ ) {
+		const HalBusEvent &e = busLog[i];
+		if ( e.bus == HAL_BUS_SPI )
+			frame.push_back(e.data);
+		else if ( e.bus == HAL_BUS_GPIO && e.data == HIGH && !frame.empty() ) {
+			for ( size_t j = 0; j + 1 < frame.size(); j += 2 )
+				words.push_back((uint16_t)(frame[j] << 8) | frame[j + 1]);
+			frame.clear();
+		}
+	}
+	return words;
+}
+
+std::vector<uint16_t> halFakeSpiWordsTo ( uint8_t fsyncPin,
+		std::vector<uint64_t> *cycles ) {
+	std::vector<uint16_t> words;
+	std::vector<uint8_t> frame;
+	bool selected = false;
+	for ( size_t i = 0; i < busLog.size(); i++ ) {
+		const HalBusEvent &e = busLog[i];
+		if ( e.bus == HAL_BUS_SPI && selected )
+			frame.push_back(e.data);
+		else if ( e.bus == HAL_BUS_GPIO && e.address == fsyncPin ) {
+			selected = e.data == LOW;
+			if ( selected ) continue;
+			for ( size_t j = 0; j + 1 < frame.size(); j += 2 ) {
+				words.push_back((uint16_t)(frame[j] << 8) | frame[j + 1]);
+				if ( cycles ) cycles->push_back(e.cycle);
+			}
+			frame.clear();
+		}
+	}
+	return words;
+}
+
+uint8_t halFakePin ( uint8_t pin ) { return pinLevel[pin & 31]; }
+
+void halFakeSetInput ( uint8_t pin, uint8_t level ) {
+	pinLevel[pin & 31] = level ? HIGH : LOW;
+}
+
+void halFakeI2cNack ( bool nack ) { i2cNack = nack; }
+
+const std::string &halFakeSerialOutput ( void ) { return serialOut; }
+void halFakeClearSerial ( void ) { serialOut.clear(); }
+void halFakeSerialEcho ( bool echo ) { serialEcho = echo; }
+void halFakeSerialInput ( const std::string &bytes ) { serialIn += bytes; }
+
+void halFakeEepromErase ( void ) {
+	eepromBlank = true;
+	EepromInit();
+}
+
+uint8_t *halFakeEeprom ( void ) {
+	EepromInit();
+	return eeprom;
+}
+
+// Static initialisation: start as after a power-on reset
+static struct HalFakeInit {
+	HalFakeInit ( ) { halFakeReset(); }
+} halFakeInit;
+
+#endif
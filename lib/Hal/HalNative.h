@@ -0,0 +1,225 @@
+/*
+ * HalNative.h
+ *
+ * Host (Linux) backend of the HAL for the "native" PlatformIO
+ * environment. All peripherals are recording fakes driven by a virtual
+ * CPU clock:
+ *
+ *	- every SPI byte, I2C transfer and GPIO write is appended to a bus log
+ *	  together with the virtual cycle it completed on
+ *	- queued I2C writes go out back to back in virtual time while the CPU
+ *	  keeps running; completions run as TWI interrupts
+ *	- bus operations advance the clock by their modelled cost (SPI and
+ *	  TWI clocks as on the board, core digitalWrite() ~ 4 us)
+ *	- Timer1 counts virtual cycles / 8 and calls HAL_TIMER_COMPARE_ISR /
+ *	  HAL_TIMER_COMPARE_B_ISR when the clock is advanced across a match
+ *	- the Timer2 ticker calls HAL_TICKER_ISR every period the same way
+ *	- halFakeTrigger() runs HAL_TRIGGER_ISR like a TTL edge on pin 3;
+ *	  halFakeTriggerAt() latches one at a cycle, taken when interrupts are
+ *	  next enabled, like the INT1 flag
+ *	- Serial is a 64 byte TX FIFO that drains at 115200 baud of virtual
+ *	  time and blocks (advances the clock) when full, like HardwareSerial
+ *
+ * Latency and bus cost regressions can then be measured as plain cycle
+ * counts on the build machine.
+ */
+
+#ifndef HalNative_h
+#define HalNative_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#define HIGH			1
+#define LOW				0
+#define INPUT			0
+#define OUTPUT			1
+#define INPUT_PULLUP	2
+
+#define highByte(w)		((uint8_t)((w) >> 8))
+#define lowByte(w)		((uint8_t)((w) & 0xFF))
+
+struct HalPin {
+	uint8_t		port;		// as on the Nano: 0 = D (0-7), 1 = B (8-13), 2 = C
+	uint32_t	pins;		// one bit per pin number
+};
+
+typedef uint8_t HalIrqState;
+
+// The vectors become plain functions the fake calls. They are weak in
+// the fake, so driver-only test programs link without them.
+#define HAL_TRIGGER_ISR			void halTriggerVector ( void )
+#define HAL_TIMER_COMPARE_ISR	void halTimerCompareVector ( void )
+#define HAL_TIMER_COMPARE_B_ISR	void halTimerCompareBVector ( void )
+#define HAL_TICKER_ISR			void halTickerVector ( void )
+void halTriggerVector ( void );
+void halTimerCompareVector ( void );
+void halTimerCompareBVector ( void );
+void halTickerVector ( void );
+
+// --------------------- HAL API (see HalAvr.h) ----------------------
+
+uint32_t halMillis ( void );
+uint32_t halMicros ( void );
+void halDelay ( uint32_t ms );
+bool halPowerOnReset ( void );
+
+HalIrqState halIrqSave ( void );
+void halIrqRestore ( HalIrqState state );
+void halTriggerEnable ( void );
+void halTriggerDisable ( void );
+
+uint8_t halTriggerPort ( void );
+void halPinMode ( uint8_t pin, uint8_t mode );
+void halDigitalWrite ( uint8_t pin, uint8_t val );
+HalPin halPin ( uint8_t pin );
+void halPinLow ( const HalPin &p );
+void halPinHigh ( const HalPin &p );
+bool halPinAdd ( HalPin &p, uint8_t pin );
+template < uint8_t Pin > inline void halPinLowFast ( void ) { halPinLow(halPin(Pin)); }
+template < uint8_t Pin > inline void halPinHighFast ( void ) { halPinHigh(halPin(Pin)); }
+
+void halSpiBegin ( void );
+void halSpiMode2 ( void );
+#define HAL_SPI_MODE2			2
+void halSpiBeginTransaction ( uint32_t hz, uint8_t mode );
+void halSpiEndTransaction ( void );
+uint8_t halSpiTransfer ( uint8_t b );
+void halSpiWriteRaw ( uint8_t b );
+uint16_t halSpiByteCycles ( void );
+
+void halI2cBegin ( void );
+void halI2cSetClock ( uint32_t hz );
+uint8_t halI2cWrite ( uint8_t address, const uint8_t *data, uint8_t n );
+bool halI2cWriteAsync ( uint8_t address, const uint8_t *data, uint8_t n,
+	HalI2cDone done = 0, void *context = 0, uint8_t tag = 0 );
+uint8_t halI2cPending ( void );
+void halI2cFlush ( void );
+uint8_t halI2cWriteRaw ( uint8_t address, const uint8_t *data, uint8_t n );
+uint16_t halI2cBitCycles ( void );
+
+void halTimerBegin ( void );
+uint16_t halTimerNow ( void );
+uint64_t halTimerTicks64 ( void );
+uint64_t halTimerExtend ( uint16_t tick );
+uint16_t halTimerCompare ( void );
+void halTimerSetCompare ( uint16_t ticks );
+void halTimerCompareEnable ( bool enable );
+uint16_t halTimerCompareB ( void );
+void halTimerSetCompareB ( uint16_t ticks );
+void halTimerCompareBEnable ( bool enable );
+
+void halTickerStart ( uint16_t ticks );
+void halTickerStop ( void );
+
+#define HAL_FLASH
+void halFlashRead ( void *dst, const void *src, size_t n );
+
+#define HAL_EEPROM_SIZE			1024
+uint8_t halEepromRead ( uint16_t address );
+void halEepromReadBlock ( void *dst, uint16_t address, size_t n );
+bool halEepromReady ( void );
+void halEepromWrite ( uint16_t address, uint8_t b );
+
+// --------------------- Serial ----------------------
+
+class Print {
+public:
+	virtual ~Print ( ) { }
+	virtual size_t write ( uint8_t b ) = 0;
+	virtual size_t write ( const uint8_t *buffer, size_t size );
+	virtual int availableForWrite ( void ) { return 0; }
+
+	size_t print ( const char *s );
+	size_t print ( char c );
+	size_t print ( unsigned char n ) { return print((unsigned long)n); }
+	size_t print ( int n ) { return print((long)n); }
+	size_t print ( unsigned int n ) { return print((unsigned long)n); }
+	size_t print ( long n );
+	size_t print ( unsigned long n );
+	size_t println ( void ) { return print("\r\n"); }
+	template <typename T> size_t println ( T v ) { return print(v) + println(); }
+};
+
+class HalSerial : public Print {
+public:
+	void begin ( unsigned long baud );
+	size_t write ( uint8_t b );
+	using Print::write;
+	int availableForWrite ( void );
+	int available ( void );
+	int read ( void );
+};
+
+extern HalSerial Serial;
+
+// --------------------- Fake control ----------------------
+
+typedef enum {
+	HAL_BUS_SPI,		// data = byte, sent while FSYNC (any pin LOW) framing
+	HAL_BUS_I2C,		// address = 7 bit address, data = byte, status
+	HAL_BUS_GPIO		// address = pin, data = level
+} HalBus;
+
+struct HalBusEvent {
+	uint64_t	cycle;		// virtual cycle the transfer completed on
+	uint8_t		bus;
+	uint8_t		address;
+	uint8_t		data;
+	uint8_t		status;		// I2C: 0 = ACK, 2 / 3 = NACK
+	bool		fromIsr;
+};
+
+// Back to reset: clock 0, empty logs, all peripherals idle. A warm
+// reset (button, serial DTR) unless halFakePowerOn() follows
+void halFakeReset ( void );
+void halFakePowerOn ( void );
+
+// Virtual CPU clock
+uint64_t halFakeCycles ( void );
+void halFakeAdvance ( uint64_t cycles );	// runs timer interrupts on the way
+void halFakeAdvanceMicros ( uint32_t us );
+
+// TTL edge on the trigger pin. Runs HAL_TRIGGER_ISR if enabled
+void halFakeTrigger ( void );
+// The same edge at a future cycle, while the clock is advanced. It waits
+// out interrupts-off sections, and edges before it is taken are one
+void halFakeTriggerAt ( uint64_t cycle );
+bool halFakeInIsr ( void );
+
+// Bus log
+const std::vector<HalBusEvent> &halFakeBusLog ( void );
+void halFakeClearBusLog ( void );
+// SPI 16 bit words framed by an FSYNC low period, in order
+std::vector<uint16_t> halFakeSpiWords ( void );
+
+// Words one device received: SPI bytes while its FSYNC pin was low, and
+// optionally the cycle each word was latched on (FSYNC rising)
+std::vector<uint16_t> halFakeSpiWordsTo ( uint8_t fsyncPin,
+	std::vector<uint64_t> *cycles = 0 );
+
+// Pin level last written
+uint8_t halFakePin ( uint8_t pin );
+
+// Drive an input pin from outside, e.g. the stimulus select lines
+void halFakeSetInput ( uint8_t pin, uint8_t level );
+
+// EEPROM contents survive halFakeReset(), like on the board. Erase sets
+// every cell to 0xFF
+void halFakeEepromErase ( void );
+uint8_t *halFakeEeprom ( void );
+
+// Make the I2C slave NACK its address
+void halFakeI2cNack ( bool nack );
+
+// Serial output so far. Echo copies it to stdout as it is written
+const std::string &halFakeSerialOutput ( void );
+void halFakeClearSerial ( void );
+void halFakeSerialEcho ( bool echo );
+
+// Bytes for Serial.read(), available at once
+void halFakeSerialInput ( const std::string &bytes );
+
+#endif
@@ -97,10 +97,12 @@
   @example PT2258_ML_example_full/PT2258_ML_example_full.ino
 */
 
-#include <Arduino.h>
-#include <Wire.h>
 #include "PT2258.h"
 
+// Transfer tags: channel index 0 - 5, or
+#define TAG_ALL   PT2258_CHANNELS
+#define TAG_MUTE  (PT2258_CHANNELS + 1)
+
 uint8_t channel_address_1[6] = {
   PT2258_CH1_1,
   PT2258_CH2_1,
@@ -127,6 +129,12 @@ uint8_t channel_address_10[6] = {
 PT2258::PT2258(uint8_t _address)
 {
   address = _address >> 1;   // right-shift one bit because Wire library uses 7bit addresses
+  inFlight = errorCount = 0;
+  async = false;
+#ifdef PROBES
+  probeSent = probeDone = 0;
+#endif
+  invalidate();
 }
 
 /*!
@@ -136,12 +144,12 @@ PT2258::PT2258(uint8_t _address)
   */
 uint8_t PT2258::begin(void)
 {
-  //Wire.setClock(100000);  // setting the clock to 100kHz as indicated in the datasheet
+  //halI2cSetClock(100000);  // setting the clock to 100kHz as indicated in the datasheet
   uint8_t return_status = 0;
+  uint8_t clear = PT2258_CLEAR_REGISTER;
 
-  Wire.beginTransmission(address);
-  Wire.write(PT2258_CLEAR_REGISTER);
-  return_status = Wire.endTransmission();
+  return_status = halI2cWrite(address, &clear, 1);   // waits for queued writes too
+  invalidate();
 
   if(return_status != 0) return_status = 0; // Wire transmission error
   else return_status = 1;
@@ -157,11 +165,7 @@ uint8_t PT2258::begin(void)
   */
 void PT2258::attenuation(uint8_t channel, uint8_t attenuation)
 {
-  uint8_t c = attenuation;
-  uint8_t a = c / 10;
-  uint8_t b = c - a * 10;
-
-  PT2258Send(channel_address_10[channel-1] + a, channel_address_1[channel-1] + b);
+  setAttenuation(channel, attenuation);
 }
 
 /*!
@@ -171,11 +175,7 @@ void PT2258::attenuation(uint8_t channel, uint8_t attenuation)
   */
 void PT2258::attenuationAll(uint8_t attenuation)
 {
-  uint8_t c = attenuation;
-  uint8_t a = c / 10;
-  uint8_t b = c - a * 10;
-
-  PT2258Send(PT2258_CHALL_10 + a, PT2258_CHALL_1 + b);
+  setAttenuationAll(attenuation);
 }
 
  /*!
@@ -186,11 +186,9 @@ void PT2258::attenuationAll(uint8_t attenuation)
   */
 void PT2258::volume(uint8_t channel, uint8_t volume)
 {
-  uint8_t c = map(volume, 0, 100, 79, 0);
-  uint8_t a = c / 10;
-  uint8_t b = c - a * 10;
+  uint8_t c = 79 - (uint16_t)volume * 79 / 100;   // map(volume, 0, 100, 79, 0)
 
-  PT2258Send(channel_address_10[channel-1] + a, channel_address_1[channel-1] + b);
+  setAttenuation(channel, c);
 }
 
 /*!
@@ -200,11 +198,9 @@ void PT2258::volume(uint8_t channel, uint8_t volume)
   */
 void PT2258::volumeAll(uint8_t volume)
 {
-  uint8_t c = map(volume, 0, 100, 79, 0);
-  uint8_t a = c / 10;
-  uint8_t b = c - a * 10;
+  uint8_t c = 79 - (uint16_t)volume * 79 / 100;   // map(volume, 0, 100, 79, 0)
 
-  PT2258Send(PT2258_CHALL_10 + a, PT2258_CHALL_1 + b);
+  setAttenuationAll(c);
 }
 /*!
   * @brief Mute control for all the channels. No matter the volume, the channels will stay silent.
@@ -214,9 +210,47 @@ void PT2258::volumeAll(uint8_t volume)
   */
 void PT2258::mute(bool mute)
 {
-  Wire.beginTransmission(address);
-  Wire.write(PT2258_CHALL_MUTE + mute);
-  Wire.endTransmission();
+  if(shadowMute == mute) return;   // already in that state
+
+  uint8_t command = PT2258_CHALL_MUTE + mute;
+
+  shadowMute = mute;
+  send(&command, 1, TAG_MUTE);
+}
+
+/*!
+  * @brief Forget the shadowed IC state, so every following write is sent
+  */
+void PT2258::invalidate(void)
+{
+  for(uint8_t i = 0; i < PT2258_CHANNELS; i++) shadowAttenuation[i] = PT2258_UNKNOWN;
+  shadowMute = PT2258_UNKNOWN;
+}
+
+/*!
+  * @brief Queue the following writes instead of waiting for each
+  *
+  * @param enable Queued (true) or blocking (false, default)
+  */
+void PT2258::setAsync(bool enable)
+{
+  async = enable;
+}
+
+/*!
+  * @return true while writes of this object are queued or in progress
+  */
+bool PT2258::busy(void)
+{
+  return inFlight != 0;
+}
+
+/*!
+  * @return Number of writes that were not acknowledged
+  */
+uint8_t PT2258::errors(void)
+{
+  return errorCount;
 }
 
 /*!
@@ -224,11 +258,87 @@ void PT2258::mute(bool mute)
    *
    * @param a 10dB byte value
    * @param b 1dB byte value
+   * @param tag Shadow the write belongs to
    */
-void PT2258::PT2258Send(uint8_t a, uint8_t b)
+void PT2258::PT2258Send(uint8_t a, uint8_t b, uint8_t tag)
 {
-  Wire.beginTransmission(address);
-  Wire.write(a);
-  Wire.write(b);
-  Wire.endTransmission();
+  uint8_t data[2] = { a, b };
+
+  send(data, 2, tag);
+}
+
+/*!
+  * @brief Blocking or queued write. The shadow is already updated; done()
+  * forgets it again if the transfer fails.
+  */
+void PT2258::send(const uint8_t *data, uint8_t n, uint8_t tag)
+{
+  HalIrqState state = halIrqSave();
+  inFlight++;
+#ifdef PROBES
+  probeStart[probeSent++ & (HAL_I2C_QUEUE_SIZE - 1)] = halTimerNow();
+#endif
+  halIrqRestore(state);
+
+  if(async) {
+    while(!halI2cWriteAsync(address, data, n, done, this, tag)) ;   // queue full: wait for a slot
+  }
+  else {
+    done(this, tag, halI2cWrite(address, data, n));
+  }
+}
+
+/*!
+  * @brief Transfer completion, from the TWI interrupt in queued mode
+  */
+void PT2258::done(void *context, uint8_t tag, uint8_t status)
+{
+  PT2258 *self = (PT2258 *)context;
+
+  HalIrqState state = halIrqSave();
+  self->inFlight--;
+#ifdef PROBES
+  PROBE_END(PROBE_PT2258, self->probeStart[self->probeDone++ & (HAL_I2C_QUEUE_SIZE - 1)]);
+#endif
+  if(status != 0) {
+    self->errorCount++;
+    if(tag == TAG_MUTE) self->shadowMute = PT2258_UNKNOWN;
+    else if(tag == TAG_ALL) {
+      for(uint8_t i = 0; i < PT2258_CHANNELS; i++) self->shadowAttenuation[i] = PT2258_UNKNOWN;
+    }
+    else self->shadowAttenuation[tag] = PT2258_UNKNOWN;
+  }
+  halIrqRestore(state);
+}
+
+/*!
+  * @brief Write one channel attenuation unless the IC already has it
+  */
+void PT2258::setAttenuation(uint8_t channel, uint8_t attenuation)
+{
+  if(shadowAttenuation[channel-1] == attenuation) return;
+
+  uint8_t c = attenuation;
+  uint8_t a = c / 10;
+  uint8_t b = c - a * 10;
+
+  shadowAttenuation[channel-1] = attenuation;
+  PT2258Send(channel_address_10[channel-1] + a, channel_address_1[channel-1] + b, channel-1);
+}
+
+/*!
+  * @brief Write all channel attenuations unless the IC already has them
+  */
+void PT2258::setAttenuationAll(uint8_t attenuation)
+{
+  uint8_t i = 0;
+  while(i < PT2258_CHANNELS && shadowAttenuation[i] == attenuation) i++;
+  if(i == PT2258_CHANNELS) return;
+
+  uint8_t c = attenuation;
+  uint8_t a = c / 10;
+  uint8_t b = c - a * 10;
+
+  for(i = 0; i < PT2258_CHANNELS; i++) shadowAttenuation[i] = attenuation;
+  PT2258Send(PT2258_CHALL_10 + a, PT2258_CHALL_1 + b, TAG_ALL);
 }
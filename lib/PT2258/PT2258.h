@@ -37,7 +37,8 @@
 #ifndef PT2258_h
 #define PT2258_h
 
-#include <Arduino.h>
+#include "Hal.h"
+#include "Probe.h"
 
 /* channel addresses */
 #define PT2258_CLEAR_REGISTER 0b11000000 // 0xC0
@@ -57,7 +58,37 @@
 #define PT2258_CH6_10         0b10100000 // 0xA0
 #define PT2258_CHALL_MUTE     0b11111000 // 0xF8
 
+#define PT2258_CHANNELS       6
+#define PT2258_UNKNOWN        0xFF       // shadow value not known
 
+
+/*
+  Gating mode
+  ----------------------------------------------------------------------------------
+  The object keeps a shadow of every channel attenuation and of the mute
+  state, and writes that would not change the IC are not sent. For a fixed
+  stimulus level, set the attenuation once and gate the sound with mute()
+  only: the per trial traffic is then one single byte transfer each way.
+
+    pt2258.mute(true);
+    pt2258.attenuation(1, level);   // once, in setup()
+    ...
+    pt2258.mute(false);             // onset
+    pt2258.mute(true);              // offset
+
+  Call invalidate() after writing to the IC behind the object's back (or
+  after a power cycle of the IC), so the next writes go out again.
+
+
+  Queued mode
+  ----------------------------------------------------------------------------------
+  After setAsync(true) the volume and mute calls put their bytes on the HAL
+  I2C queue and return at once; the TWI interrupt sends them while loop()
+  carries on. A failed transfer is counted in errors() and makes the
+  shadow of what it wrote unknown, so the next call repeats it. busy()
+  tells whether transfers of this object are still queued. begin() always
+  waits for its result.
+*/
 class PT2258 {
 public:
 
@@ -69,13 +100,29 @@ public:
   void volume(uint8_t channel,  uint8_t volume);
   void volumeAll(uint8_t volume);
   void mute(bool mute);
+  void invalidate(void);
+  void setAsync(bool enable);
+  bool busy(void);
+  uint8_t errors(void);
 
 private:
   /*!
    * @param current - IC address
    */
   uint8_t address;
-  void PT2258Send(uint8_t a, uint8_t b);
+  volatile uint8_t shadowAttenuation[PT2258_CHANNELS];
+  volatile uint8_t shadowMute;
+  volatile uint8_t inFlight, errorCount;
+  bool async;
+#ifdef PROBES
+  uint16_t probeStart[HAL_I2C_QUEUE_SIZE];   // send() stamps, completed in order
+  uint8_t probeSent, probeDone;
+#endif
+  void PT2258Send(uint8_t a, uint8_t b, uint8_t tag);
+  void send(const uint8_t *data, uint8_t n, uint8_t tag);
+  static void done(void *context, uint8_t tag, uint8_t status);
+  void setAttenuation(uint8_t channel, uint8_t attenuation);
+  void setAttenuationAll(uint8_t attenuation);
 
 };
 
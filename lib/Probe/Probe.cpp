@@ -0,0 +1,48 @@
+/*
+ * Probe.cpp
+ *
+ * Trigger path histograms. See Probe.h for an overview.
+ */
+
+#include "Probe.h"
+
+#ifdef PROBES
+ProbeHistogram probes[PROBE_COUNT];
+volatile uint16_t probeOrigin;
+const char *const probeNames[PROBE_COUNT] = {
+	"isr", "pickup", "onset", "pt2258", "apply", "enable"
+};
+#endif
+
+void ProbeHistogram :: Record ( uint16_t ticks ) {
+	uint8_t b = Bucket(ticks);
+	HalIrqState state = halIrqSave();
+	if ( !count || ticks < min ) min = ticks;
+	if ( ticks > max ) max = ticks;
+	if ( count != 0xFFFF ) count++;
+	if ( buckets[b] != 0xFFFF ) buckets[b]++;
+	halIrqRestore(state);
+}
+
+void ProbeHistogram :: Clear ( void ) {
+	HalIrqState state = halIrqSave();
+	count = min = max = 0;
+	for ( uint8_t i = 0; i < PROBE_BUCKETS; i++ ) buckets[i] = 0;
+	halIrqRestore(state);
+}
+
+/*
+ * Bit length of ticks, high byte first so it is at most 8 shifts
+ */
+uint8_t ProbeHistogram :: Bucket ( uint16_t ticks ) {
+	uint8_t b = 0;
+	if ( ticks >> 8 ) {
+		b = 8;
+		ticks >>= 8;
+	}
+	while ( ticks ) {
+		b++;
+		ticks >>= 1;
+	}
+	return b < PROBE_BUCKETS ? b : PROBE_BUCKETS - 1;
+}
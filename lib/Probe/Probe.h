@@ -0,0 +1,80 @@
+/*
+ * Probe.h
+ *
+ * Trigger path probes: Timer1 tick histograms of where the time goes
+ * between the TTL edge and the sound. Build with -DPROBES (the
+ * nanoatmega328new_probes environment). Without it every macro below is
+ * empty and the histograms are not even allocated, so the probes cost no
+ * cycles and no SRAM.
+ *
+ * Two kinds of probe:
+ *
+ *	PROBE_TRIGGER(ticks)			trigger ISR entry: the time origin
+ *	PROBE_SINCE_TRIGGER(id)			ticks from the latest trigger to here
+ *	PROBE_BEGIN(start);				declare uint16_t start = now
+ *	PROBE_END(id, start)			ticks from PROBE_BEGIN(start) to here
+ *
+ * Each probe has a histogram of PROBE_BUCKETS power-of-two buckets:
+ * bucket 0 counts 0 ticks, bucket b counts [2^(b-1), 2^b) ticks and the
+ * last one everything from 2^(PROBE_BUCKETS-2) ticks (8.2 ms) up, next
+ * to count, min and max. Counts stop at 65535. A Record() is a few dozen
+ * cycles with interrupts off, so ISRs and loop() can share a probe.
+ */
+
+#ifndef Probe_h
+#define Probe_h
+
+#include "Hal.h"
+
+#define PROBE_BUCKETS		16
+
+typedef enum {
+	PROBE_ISR,				// trigger ISR, entry to return
+	PROBE_PICKUP,			// edge to loop() taking the trigger
+	PROBE_ONSET,			// edge to the onset control word
+	PROBE_PT2258,			// PT2258 write, call to transfer done
+	PROBE_APPLY,			// AD9833::ApplySignal()
+	PROBE_ENABLE,			// AD9833::EnableOutput(true)
+	PROBE_COUNT
+} ProbeId;
+
+class ProbeHistogram {
+
+public:
+
+	void Record ( uint16_t ticks );
+	void Clear ( void );
+
+	// Bucket a tick count falls in
+	static uint8_t Bucket ( uint16_t ticks );
+
+	// Lower bound of a bucket in ticks
+	static uint16_t BucketFloor ( uint8_t bucket ) {
+		return bucket ? 1U << (bucket - 1) : 0;
+	}
+
+	uint16_t		count, min, max;
+	uint16_t		buckets[PROBE_BUCKETS];
+};
+
+#ifdef PROBES
+
+extern ProbeHistogram probes[PROBE_COUNT];
+extern volatile uint16_t probeOrigin;
+extern const char *const probeNames[PROBE_COUNT];
+
+#define PROBE_TRIGGER(ticks)		(probeOrigin = (ticks))
+#define PROBE_SINCE_TRIGGER(id)		probes[id].Record(halTimerNow() - probeOrigin)
+#define PROBE_BEGIN(start)			uint16_t start = halTimerNow()
+#define PROBE_END(id, start)		probes[id].Record(halTimerNow() - (start))
+
+#else
+
+#define PROBE_TRIGGER(ticks)		do { } while ( 0 )
+#define PROBE_SINCE_TRIGGER(id)		do { } while ( 0 )
+#define PROBE_BEGIN(start)			do { } while ( 0 )
+#define PROBE_END(id, start)		do { } while ( 0 )
+
+#endif
+
+#endif
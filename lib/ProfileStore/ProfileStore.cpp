@@ -0,0 +1,96 @@
+/*
+ * ProfileStore.cpp
+ *
+ * EEPROM stimulus profiles. See ProfileStore.h for an overview.
+ */
+
+#include "ProfileStore.h"
+
+ProfileStore :: ProfileStore ( void ) {
+	source = 0;
+	base = position = crc = writes = 0;
+	saving = false;
+	loadTicks = crcTicks = 0;
+}
+
+uint8_t ProfileStore :: Load ( uint8_t slot, void *dst, uint16_t size,
+		uint8_t version ) {
+	uint16_t start = halTimerNow();
+	loadTicks = crcTicks = 0;
+	if ( slot >= PROFILE_SLOTS ) return PROFILE_BAD_SLOT;
+
+	ProfileHeader h;
+	uint16_t address = Address(slot);
+	halEepromReadBlock(&h, address, sizeof(h));
+	address += sizeof(h);
+
+	uint8_t status = PROFILE_OK;
+	if ( h.magic != PROFILE_MAGIC ) status = PROFILE_EMPTY;
+	else if ( h.version != version ) status = PROFILE_BAD_VERSION;
+	else if ( h.size != size || size > PROFILE_MAX_BODY ) status = PROFILE_BAD_SIZE;
+	else {
+		uint16_t crcStart = halTimerNow();
+		uint16_t c = 0xFFFF;
+		for ( uint16_t i = 0; i < size; i++ ) c = Crc(c, halEepromRead(address + i));
+		crcTicks = halTimerNow() - crcStart;
+		if ( c != h.crc ) status = PROFILE_BAD_CRC;
+		else halEepromReadBlock(dst, address, size);
+	}
+
+	loadTicks = halTimerNow() - start;
+	return status;
+}
+
+uint8_t ProfileStore :: BeginSave ( uint8_t slot, const void *src,
+		uint16_t size, uint8_t version ) {
+	if ( slot >= PROFILE_SLOTS ) return PROFILE_BAD_SLOT;
+	if ( size > PROFILE_MAX_BODY ) return PROFILE_BAD_SIZE;
+
+	source = (const uint8_t *)src;
+	header.magic = PROFILE_MAGIC;
+	header.version = version;
+	header.reserved = 0;
+	header.size = size;
+	base = Address(slot);
+	position = 0;
+	crc = 0xFFFF;
+	writes = 0;
+	saving = true;
+	return PROFILE_OK;
+}
+
+/*
+ * position runs over the body, then over the header, which gets the CRC
+ * once the last body byte has gone out
+ */
+bool ProfileStore :: SaveStep ( void ) {
+	if ( !saving ) return true;
+	if ( !halEepromReady() ) return false;
+
+	uint16_t total = header.size + sizeof(header);
+	while ( position < total ) {
+		uint16_t address;
+		uint8_t b;
+		if ( position < header.size ) {
+			b = source[position];
+			crc = Crc(crc, b);
+			address = base + sizeof(header) + position;
+		}
+		else {
+			if ( position == header.size ) header.crc = crc;
+			uint16_t i = position - header.size;
+			b = ((const uint8_t *)&header)[i];
+			address = base + i;
+		}
+		position++;
+
+		if ( halEepromRead(address) != b ) {
+			halEepromWrite(address, b);
+			writes++;
+			return false;
+		}
+	}
+
+	saving = false;
+	return true;
+}
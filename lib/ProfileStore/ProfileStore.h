@@ -0,0 +1,104 @@
+/*
+ * ProfileStore.h
+ *
+ * Stimulus profiles in EEPROM. The EEPROM is split into PROFILE_SLOTS
+ * slots of PROFILE_SLOT_SIZE bytes; each holds one profile struct behind
+ * a header:
+ *
+ *	magic u16  version u8  reserved u8  size u16  crc u16  body[size]
+ *
+ * crc is CRC-16/CCITT-FALSE (0x1021, initial 0xFFFF) over the body. The
+ * caller owns the layout of the body and bumps its version when the
+ * layout changes, so a profile saved by older firmware is refused instead
+ * of being read into the wrong fields.
+ *
+ * Load() checks the header and the CRC straight from the EEPROM and only
+ * then reads the body into the caller's struct, in one pass, so the
+ * struct is either the saved profile or untouched (the compiled-in
+ * defaults). Load time and the share spent on the CRC are kept in Timer1
+ * ticks.
+ *
+ * Saving never blocks: BeginSave() takes the struct and SaveStep(), called
+ * from loop(), starts at most one cell write (~3.4 ms each) whenever the
+ * EEPROM is idle. Cells that already hold the right value are skipped.
+ * The body goes first and the header last, so a save cut short by a reset
+ * leaves a slot that fails its CRC, never one that loads half old, half
+ * new.
+ */
+
+#ifndef ProfileStore_h
+#define ProfileStore_h
+
+#include "Hal.h"
+
+#define PROFILE_MAGIC		0x5054		// "TP"
+#define PROFILE_SLOT_SIZE	256
+#define PROFILE_SLOTS		(HAL_EEPROM_SIZE / PROFILE_SLOT_SIZE)
+#define PROFILE_MAX_BODY	(PROFILE_SLOT_SIZE - sizeof(ProfileHeader))
+
+typedef enum {
+	PROFILE_OK,
+	PROFILE_EMPTY,				// no profile saved in the slot
+	PROFILE_BAD_VERSION,
+	PROFILE_BAD_SIZE,
+	PROFILE_BAD_CRC,
+	PROFILE_BAD_SLOT
+} ProfileStatus;
+
+struct ProfileHeader {
+	uint16_t	magic;
+	uint8_t		version;
+	uint8_t		reserved;
+	uint16_t	size;
+	uint16_t	crc;
+};
+
+class ProfileStore {
+
+public:
+
+	ProfileStore ( void );
+
+	// Copy the profile in slot into dst (size bytes) if it has this
+	// version and size and a good CRC. dst is untouched otherwise
+	uint8_t Load ( uint8_t slot, void *dst, uint16_t size, uint8_t version );
+
+	// Start saving size bytes of src into slot. src is read while the
+	// save goes on, and the CRC covers what was actually written
+	uint8_t BeginSave ( uint8_t slot, const void *src, uint16_t size,
+		uint8_t version );
+
+	// Continue the save: start the next cell write if the EEPROM is idle.
+	// Returns true when no save is in progress (any more)
+	bool SaveStep ( void );
+
+	bool IsSaving ( void ) const { return saving; }
+
+	// Cells written by the last save (unchanged ones are skipped)
+	uint16_t Writes ( void ) const { return writes; }
+
+	// Last Load(): total time and the CRC pass, in Timer1 ticks
+	uint16_t LoadTicks ( void ) const { return loadTicks; }
+	uint16_t CrcTicks ( void ) const { return crcTicks; }
+
+	static uint16_t Crc ( uint16_t crc, uint8_t b ) {
+		crc = (crc >> 8) | (crc << 8);
+		crc ^= b;
+		crc ^= (crc & 0xFF) >> 4;
+		crc ^= crc << 12;
+		crc ^= (crc & 0xFF) << 5;
+		return crc;
+	}
+
+private:
+
+	static uint16_t	Address ( uint8_t slot ) { return slot * PROFILE_SLOT_SIZE; }
+
+	const uint8_t	*source;
+	ProfileHeader	header;
+	uint16_t		base, position, crc, writes;
+	bool			saving;
+	uint16_t		loadTicks, crcTicks;
+};
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * Scheduler.cpp
+ *
+ * Protothread scheduler with a hashed timer wheel. See Scheduler.h for
+ * an overview.
+ */
+
+#include "Scheduler.h"
+
+#define SCHED_WHEEL_MASK	(SCHED_WHEEL_SIZE - 1)
+
+Task :: Task ( TaskFunction function ) {
+	PT_INIT(&pt);
+	this->function = function;
+	link = slotNext = 0;
+	wake = sleepTicks = 0;
+	suspend = false;
+	state = TASK_READY;
+	maxRun = 0;
+	runs = 0;
+}
+
+Scheduler :: Scheduler ( void ) {
+	tasks = 0;
+	for ( uint8_t i = 0; i < SCHED_WHEEL_SIZE; i++ ) wheel[i] = 0;
+	tick = 0;
+	tickStart = 0;
+	ResetStats();
+}
+
+void Scheduler :: Begin ( void ) {
+	tasks = 0;
+	for ( uint8_t i = 0; i < SCHED_WHEEL_SIZE; i++ ) wheel[i] = 0;
+	tick = 0;
+	tickStart = (uint32_t)halTimerTicks64();
+	ResetStats();
+}
+
+/*
+ * Append at the end, so tasks run in the order they were added
+ */
+void Scheduler :: Add ( Task &task ) {
+	PT_INIT(&task.pt);
+	task.link = 0;
+	task.slotNext = 0;
+	task.sleepTicks = 0;
+	task.suspend = false;
+	task.state = TASK_READY;
+	Task **end = &tasks;
+	while ( *end ) end = &(*end)->link;
+	*end = &task;
+}
+
+void Scheduler :: Wake ( Task &task ) {
+	if ( task.state == TASK_SLEEPING ) Remove(task);
+	if ( task.state != TASK_ENDED ) task.state = TASK_READY;
+}
+
+void Scheduler :: RunOnce ( void ) {
+	uint16_t start = halTimerNow();
+	uint16_t inTasks = 0;
+
+	Advance();
+	for ( Task *t = tasks; t; t = t->link ) {
+		if ( t->state != TASK_READY ) continue;
+
+		uint16_t begin = halTimerNow();
+		char result = t->function(*t);
+		uint16_t took = halTimerNow() - begin;
+		inTasks += took;
+		if ( took > t->maxRun ) t->maxRun = took;
+		t->runs++;
+
+		if ( result >= PT_EXITED ) {
+			t->state = TASK_ENDED;
+		}
+		else if ( t->sleepTicks ) {
+			t->wake = tick + t->sleepTicks;
+			t->sleepTicks = 0;
+			Insert(*t);
+		}
+		else if ( t->suspend ) {
+			t->suspend = false;
+			t->state = TASK_SUSPENDED;
+		}
+	}
+
+	uint16_t overhead = (uint16_t)(halTimerNow() - start) - inTasks;
+	if ( overhead > maxOverhead ) maxOverhead = overhead;
+	avgOverhead += overhead - (avgOverhead >> 4);
+	passes++;
+}
+
+void Scheduler :: ResetStats ( void ) {
+	maxOverhead = avgOverhead = 0;
+	passes = 0;
+	for ( Task *t = tasks; t; t = t->link ) {
+		t->maxRun = 0;
+		t->runs = 0;
+	}
+}
+
+// --------------------- PRIVATE FUNCTIONS --------------------------
+
+/*
+ * Count the ticks elapsed since the last pass and visit the slot of each
+ * (every slot once when more than a turn of the wheel has passed). A task
+ * in a visited slot wakes if its tick has come; the others are a full
+ * turn or more away and stay.
+ */
+void Scheduler :: Advance ( void ) {
+	uint32_t now = (uint32_t)halTimerTicks64();
+	uint16_t elapsed = 0;
+	while ( now - tickStart >= SCHED_TICK_TIMER ) {
+		tickStart += SCHED_TICK_TIMER;
+		elapsed++;
+	}
+	if ( !elapsed ) return;
+
+	uint16_t from = tick;
+	tick += elapsed;
+	uint8_t visits = elapsed < SCHED_WHEEL_SIZE ? elapsed : SCHED_WHEEL_SIZE;
+	for ( uint8_t i = 1; i <= visits; i++ ) {
+		Task **p = &wheel[(uint16_t)(from + i) & SCHED_WHEEL_MASK];
+		while ( *p ) {
+			Task *t = *p;
+			if ( (int16_t)(tick - t->wake) >= 0 ) {
+				*p = t->slotNext;
+				t->slotNext = 0;
+				t->state = TASK_READY;
+			}
+			else p = &t->slotNext;
+		}
+	}
+}
+
+void Scheduler :: Insert ( Task &task ) {
+	Task **slot = &wheel[task.wake & SCHED_WHEEL_MASK];
+	task.slotNext = *slot;
+	*slot = &task;
+	task.state = TASK_SLEEPING;
+}
+
+void Scheduler :: Remove ( Task &task ) {
+	Task **p = &wheel[task.wake & SCHED_WHEEL_MASK];
+	while ( *p && *p != &task ) p = &(*p)->slotNext;
+	if ( *p ) *p = task.slotNext;
+	task.slotNext = 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Scheduler.h
+ *
+ * Cooperative scheduler for the loop() side of the firmware. Every task
+ * is a protothread (lib/Protothreads): a function that runs until it
+ * blocks and resumes there on its next turn, without a stack of its own.
+ *
+ *	PT_THREAD(blink ( Task &task )) {
+ *		PT_BEGIN(&task.pt);
+ *		for ( ;; ) {
+ *			toggle();
+ *			TASK_SLEEP(task, 500);			// 500 ticks = 500 ms
+ *		}
+ *		PT_END(&task.pt);
+ *	}
+ *
+ *	Task blinkTask(blink);
+ *	scheduler.Begin();
+ *	scheduler.Add(blinkTask);
+ *	for ( ;; ) scheduler.RunOnce();
+ *
+ * A task is READY (run on every pass, e.g. while it waits with
+ * PT_WAIT_UNTIL), SLEEPING until a tick deadline or SUSPENDED until
+ * another task calls Wake(). Sleeping tasks sit in a hashed timer wheel:
+ * SCHED_WHEEL_SIZE slots indexed by the low bits of the wake tick. A
+ * sleep is O(1), and each elapsed tick only visits its own slot, so
+ * sleeping tasks cost nothing on the passes in between.
+ *
+ * Ticks are SCHED_TICK_US long and counted from the 64 bit Timer1
+ * timebase (halTimerTicks64()), so they do not drift and do not depend on
+ * millis(). A pass that comes late catches up on all elapsed ticks.
+ *
+ * Tasks run in the order they were added. The scheduler measures itself:
+ * OverheadTicks() is the time of one pass spent outside the task bodies
+ * (wheel, bookkeeping and the time stamps themselves), MaxRunTicks() of a
+ * task the longest single turn it took.
+ */
+
+#ifndef Scheduler_h
+#define Scheduler_h
+
+#include "Hal.h"
+#include "pt.h"
+
+#define SCHED_WHEEL_SIZE		16		// slots, power of 2
+#define SCHED_TICK_US			1000	// scheduler tick
+#define SCHED_TICK_TIMER		(SCHED_TICK_US * HAL_TIMER_TICKS_PER_US)
+
+typedef enum {
+	TASK_READY,
+	TASK_SLEEPING,
+	TASK_SUSPENDED,
+	TASK_ENDED
+} TaskState;
+
+class Task;
+typedef char (*TaskFunction) ( Task &task );
+
+// Block the calling task for a number of ticks (>= 1), or until Wake()
+#define TASK_SLEEP(task, ticks) \
+	do { (task).Sleep(ticks); PT_YIELD(&(task).pt); } while ( 0 )
+
+#define TASK_SUSPEND(task) \
+	do { (task).Suspend(); PT_YIELD(&(task).pt); } while ( 0 )
+
+class Task {
+
+public:
+
+	Task ( TaskFunction function );
+
+	// Requests from inside the task, taken up when its turn ends
+	void Sleep ( uint16_t ticks ) { sleepTicks = ticks ? ticks : 1; }
+	void Suspend ( void ) { suspend = true; }
+
+	uint8_t State ( void ) const { return state; }
+
+	// Longest turn in Timer1 ticks, and the number of turns
+	uint16_t MaxRunTicks ( void ) const { return maxRun; }
+	uint32_t Runs ( void ) const { return runs; }
+
+	struct pt		pt;
+
+private:
+
+	friend class Scheduler;
+
+	TaskFunction	function;
+	Task			*link;			// all tasks, in Add() order
+	Task			*slotNext;		// wheel slot chain
+	uint16_t		wake;			// tick to wake on
+	uint16_t		sleepTicks;
+	bool			suspend;
+	uint8_t			state;
+	uint16_t		maxRun;
+	uint32_t		runs;
+};
+
+class Scheduler {
+
+public:
+
+	Scheduler ( void );
+
+	// Forget all tasks and start counting ticks from now
+	void Begin ( void );
+
+	// Append a task, READY from its beginning
+	void Add ( Task &task );
+
+	// Make a sleeping or suspended task READY for the next pass
+	void Wake ( Task &task );
+
+	// One pass: advance the wheel, then one turn of every READY task
+	void RunOnce ( void );
+
+	// Ticks since Begin() (wraps at 16 bits)
+	uint16_t Now ( void ) const { return tick; }
+
+	// Per-pass overhead in Timer1 ticks: worst case and a running
+	// average (1/16 weight per pass)
+	uint16_t MaxOverheadTicks ( void ) const { return maxOverhead; }
+	uint16_t OverheadTicks ( void ) const { return avgOverhead >> 4; }
+	uint32_t Passes ( void ) const { return passes; }
+
+	void ResetStats ( void );
+
+private:
+
+	void			Advance ( void );
+	void			Insert ( Task &task );
+	void			Remove ( Task &task );
+
+	Task			*tasks;
+	Task			*wheel[SCHED_WHEEL_SIZE];
+	uint16_t		tick;
+	uint32_t		tickStart;		// Timer1 time of the current tick
+	uint16_t		maxOverhead;
+	uint16_t		avgOverhead;	// x16
+	uint32_t		passes;
+};
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * StimulusSelect.cpp
+ *
+ * Stimulus selection by TTL lines. See StimulusSelect.h for an overview.
+ */
+
+#include "StimulusSelect.h"
+
+StimulusSelect :: StimulusSelect ( uint8_t fsyncPin, uint8_t firstPin,
+		uint8_t bits, StimulusEntry *table ) {
+	if ( bits < 1 ) bits = 1;
+	if ( bits > SELECT_MAX_BITS ) bits = SELECT_MAX_BITS;
+	if ( firstPin + bits > 8 ) firstPin = 8 - bits;		// stay on port D
+	fsync = halPin(fsyncPin);
+	this->table = table;
+	this->firstPin = firstPin;
+	this->bits = bits;
+	shift = firstPin;
+	mask = (1 << bits) - 1;
+	staged = SELECT_NONE;
+	selected = 0;
+	misses = 0;
+}
+
+void StimulusSelect :: Begin ( void ) {
+	for ( uint8_t i = 0; i < bits; i++ )
+		halPinMode(firstPin + i, INPUT);
+}
+
+bool StimulusSelect :: Prepare ( void ) {
+	uint8_t index = Read();
+	if ( index == staged ) return false;
+	Load(table[index]);
+	staged = index;
+	return true;
+}
+
+// --------------------- PRIVATE FUNCTIONS --------------------------
+
+/*
+ * FREQ0 LSB then MSB with B28 set, FSYNC framed, polled SPI
+ */
+void StimulusSelect :: Load ( const StimulusEntry &entry ) {
+	halPinLow(fsync);
+	halSpiWriteRaw(highByte(entry.freqLsb));
+	halSpiWriteRaw(lowByte(entry.freqLsb));
+	halPinHigh(fsync);
+	halPinLow(fsync);
+	halSpiWriteRaw(highByte(entry.freqMsb));
+	halSpiWriteRaw(lowByte(entry.freqMsb));
+	halPinHigh(fsync);
+}
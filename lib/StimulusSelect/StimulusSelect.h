@@ -0,0 +1,114 @@
+/*
+ * StimulusSelect.h
+ *
+ * Stimulus selection by TTL lines. 2 - 4 select pins on the trigger's
+ * port (port D) form an index into a RAM table of stimuli: FREQ0 words,
+ * PT2258 attenuation and duration. The trigger ISR samples all lines in
+ * the same single port read and looks the entry up:
+ *
+ *	StimulusEntry table[4] = {
+ *		stimulusEntry(9500, 20, 350),		// Hz, dB, ms
+ *		stimulusEntry(4000, 20, 350),
+ *		...
+ *	};
+ *	StimulusSelect select(FNC_PIN, 4, 2, table);	// index on pins 4, 5
+ *
+ * To keep the onset a single control word, loop() calls Prepare() while
+ * the AD9833 is held in RESET: as soon as the lines change, the entry's
+ * frequency is loaded into FREQ0 ahead of the edge. Select() in the ISR
+ * then only compares the index. Lines that change at the edge itself are
+ * still honoured; the two FREQ0 words then go out before the onset and
+ * the trigger is counted in Misses().
+ *
+ * The table lives in RAM, so it can be edited at run time; call Forget()
+ * after changing the staged entry or after writing FREQ0 elsewhere.
+ */
+
+#ifndef StimulusSelect_h
+#define StimulusSelect_h
+
+#include "Hal.h"
+#include "AD9833Words.h"
+
+#define SELECT_MAX_BITS		4
+#define SELECT_NONE			0xFF
+#define SELECT_MISS_WORDS	2			// FREQ0 LSB, MSB from Select()
+
+struct StimulusEntry {
+	uint16_t	freqLsb, freqMsb;	// FREQ0 writes
+	uint32_t	durationTicks;		// Timer1 ticks
+	uint16_t	frequencyHz;		// for the log
+	uint8_t		attenuation;		// PT2258 dB at full level
+};
+
+constexpr StimulusEntry stimulusEntry ( uint16_t frequencyInHz,
+		uint8_t attenuation, uint16_t durationMs,
+		uint32_t referenceFrequency = 25000000UL ) {
+	return StimulusEntry {
+		ad9833FreqLsb(ad9833FreqWord(frequencyInHz, referenceFrequency)),
+		ad9833FreqMsb(ad9833FreqWord(frequencyInHz, referenceFrequency)),
+		(uint32_t)(durationMs * 1000UL * HAL_TIMER_TICKS_PER_US),
+		frequencyInHz, attenuation };
+}
+
+class StimulusSelect {
+
+public:
+
+	// Select lines firstPin .. firstPin + bits - 1 (pins 0 - 7 are port D),
+	// table with 1 << bits entries. AD9833 on fsyncPin
+	StimulusSelect ( uint8_t fsyncPin, uint8_t firstPin, uint8_t bits,
+		StimulusEntry *table );
+
+	// Select pins as inputs
+	void Begin ( void );
+
+	// Index on the lines right now
+	uint8_t Read ( void ) const { return (halTriggerPort() >> shift) & mask; }
+
+	// Load FREQ0 for the index on the lines unless it is already there.
+	// Only while the AD9833 is in RESET and with interrupts off; SPI must
+	// be set up for the AD9833 (TriggerPlan::Arm). Returns true if it wrote
+	bool Prepare ( void );
+
+	// FREQ0 no longer holds the staged entry
+	void Forget ( void ) { staged = SELECT_NONE; }
+
+	// From the trigger ISR: one port read, FREQ0 loaded if the index was
+	// not prepared. Returns the selected entry
+	inline const StimulusEntry &Select ( void ) {
+		return Select(halTriggerPort());
+	}
+
+	// The same for a port value read earlier, e.g. at a queued edge
+	inline const StimulusEntry &Select ( uint8_t port ) {
+		uint8_t index = (port >> shift) & mask;
+		if ( index != staged ) {
+			Load(table[index]);
+			staged = index;
+			misses++;
+		}
+		selected = index;
+		return table[index];
+	}
+
+	uint8_t Selected ( void ) const { return selected; }
+	uint8_t Staged ( void ) const { return staged; }
+	StimulusEntry &Entry ( uint8_t index ) { return table[index & mask]; }
+	uint8_t Count ( void ) const { return mask + 1; }
+
+	// Triggers whose index had not been prepared (+2 SPI words at onset)
+	uint16_t Misses ( void ) const { return misses; }
+
+private:
+
+	void			Load ( const StimulusEntry &entry );
+
+	HalPin			fsync;
+	StimulusEntry	*table;
+	uint8_t			firstPin, bits, shift, mask;
+	volatile uint8_t	staged, selected;
+	volatile uint16_t	misses;
+};
+
+#endif
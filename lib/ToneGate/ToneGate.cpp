@@ -0,0 +1,60 @@
+/*
+ * ToneGate.cpp
+ *
+ * Timer1 output-compare tone gate. See ToneGate.h for an overview.
+ */
+
+#include "ToneGate.h"
+
+ToneGate :: ToneGate ( void ) {
+	remaining = durationTicks = 0;
+	lateTicks = 0;
+	leadTicks = 0;
+	active = stopped = false;
+}
+
+/*
+ * Take Timer1 over from the core as a free running counter at /8
+ */
+void ToneGate :: Begin ( void ) {
+	halTimerBegin();
+}
+
+/*
+ * Schedule the offset durationTicks after the onset tick, so work done
+ * between the onset word and this call does not lengthen the tone, less
+ * the lead for the stop words. A first match that has already passed is
+ * taken at once.
+ */
+void ToneGate :: Start ( uint16_t onset, uint32_t duration ) {
+	if ( duration < GATE_MIN_TICKS ) duration = GATE_MIN_TICKS;
+
+	HalIrqState state = halIrqSave();
+	durationTicks = duration;
+	remaining = duration - leadTicks;
+	if ( duration < leadTicks + GATE_MIN_TICKS ) remaining = GATE_MIN_TICKS;
+	uint16_t step = NextStep();
+	uint16_t now = halTimerNow();
+	if ( (uint16_t)(now - onset) + 2 > step ) halTimerSetCompare(now + 2);
+	else halTimerSetCompare(onset + step);
+	halTimerCompareEnable(true);
+	active = true;
+	stopped = false;
+	halIrqRestore(state);
+}
+
+void ToneGate :: Cancel ( void ) {
+	HalIrqState state = halIrqSave();
+	halTimerCompareEnable(false);
+	remaining = 0;
+	active = false;
+	halIrqRestore(state);
+}
+
+bool ToneGate :: TakeStopped ( void ) {
+	HalIrqState state = halIrqSave();
+	bool s = stopped;
+	stopped = false;
+	halIrqRestore(state);
+	return s;
+}
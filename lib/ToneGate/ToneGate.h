@@ -0,0 +1,112 @@
+/*
+ * ToneGate.h
+ *
+ * Timer1 output-compare tone gate. Timer1 free-runs at F_CPU / 8
+ * (0.5 us per tick at 16 MHz) and the gate schedules the offset an exact
+ * number of ticks after the onset. Durations longer than one timer period
+ * are split into compare steps of at least 16384 ticks, so no match can
+ * be missed no matter how late loop() is. The match comes SetLead() ticks
+ * early, so the stop words end on time. The stop sequence itself is run
+ * by the caller from TIMER1_COMPA_vect:
+ *
+ *	ISR(TIMER1_COMPA_vect) {
+ *		if ( gate.Expired() ) {
+ *			... stop words ...
+ *			gate.Finish();
+ *		}
+ *	}
+ *
+ * Timer1 is taken over from the Arduino core, so analogWrite() on pins
+ * 9 and 10 is not available.
+ */
+
+#ifndef ToneGate_h
+#define ToneGate_h
+
+#include "Hal.h"
+
+#define GATE_TICKS_PER_US	HAL_TIMER_TICKS_PER_US
+#define GATE_MIN_TICKS		32			// shortest gate the ISR can meet
+
+class ToneGate {
+
+public:
+
+	ToneGate ( void );
+
+	// Take over Timer1: normal mode, prescaler 8
+	void Begin ( void );
+
+	// Start a gate of durationTicks from the onset at Timer1 tick onset,
+	// e.g. read right after the onset word. Safe from an ISR
+	void Start ( uint16_t onset, uint32_t durationTicks );
+
+	// Start a gate of durationTicks from now
+	void Start ( uint32_t durationTicks ) {
+		Start(halTimerNow(), durationTicks);
+	}
+
+	// Start a gate of durationUs microseconds from now
+	void StartMicros ( uint32_t durationUs ) {
+		Start(durationUs * GATE_TICKS_PER_US);
+	}
+
+	// Ticks from a compare match to the end of the stop words, e.g. from
+	// TriggerPlan::OffsetLeadCycles(). Finish() lowers it to the shortest
+	// stop measured, so a late match does not shorten the next tone
+	void SetLead ( uint16_t ticks ) { leadTicks = ticks; }
+
+	// Cancel a running gate without reporting a stop
+	void Cancel ( void );
+
+	// Called from TIMER1_COMPA_vect. Reschedules intermediate steps and
+	// returns true once the full duration has elapsed.
+	inline bool Expired ( void ) {
+		if ( remaining ) {
+			halTimerSetCompare(halTimerCompare() + NextStep());
+			return false;
+		}
+		halTimerCompareEnable(false);
+		return true;
+	}
+
+	// Called from TIMER1_COMPA_vect after the stop sequence
+	inline void Finish ( void ) {
+		uint16_t stop = halTimerNow() - halTimerCompare();
+		lateTicks = stop - leadTicks;
+		if ( stop < leadTicks ) leadTicks = stop;
+		active = false;
+		stopped = true;
+	}
+
+	bool IsActive ( void ) const { return active; }
+
+	// Returns and clears the "gate elapsed" flag set by Finish()
+	bool TakeStopped ( void );
+
+	// Ticks from the scheduled offset to the end of the stop sequence,
+	// negative when the stop words ended early
+	int16_t LateTicks ( void ) const { return lateTicks; }
+
+	// Scheduled length of the last gate in ticks
+	uint32_t DurationTicks ( void ) const { return durationTicks; }
+
+private:
+
+	// Next compare step; leaves at least 16384 ticks for every later step
+	inline uint16_t NextStep ( void ) {
+		uint16_t step;
+		if ( remaining >= 98304UL ) step = 32768U;
+		else if ( remaining > 65535UL ) step = remaining / 2;
+		else step = remaining;
+		remaining -= step;
+		return step;
+	}
+
+	volatile uint32_t	remaining, durationTicks;
+	volatile int16_t	lateTicks;
+	volatile uint16_t	leadTicks;
+	volatile bool		active, stopped;
+};
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * ToneRamp.cpp
+ *
+ * Raised-cosine onset and offset ramps. See ToneRamp.h for an overview.
+ */
+
+#include "ToneRamp.h"
+
+// -40 * log10(sin(pi/2 * k / 32)) dB, rounded, k = 0 .. 32
+static const uint8_t rampTable[RAMP_TABLE_STEPS + 1] HAL_FLASH = {
+	79, 52, 40, 33, 28, 25, 21, 19, 17, 15, 13, 12, 10, 9, 8, 7,
+	6, 5, 4, 4, 3, 3, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0,
+	0
+};
+
+ToneRamp :: ToneRamp ( PT2258 &pt2258, uint8_t channel ) : volume(pt2258) {
+	this->channel = channel;
+	level = lastAttenuation = RAMP_SILENT;
+	steps = 1;
+	period = 1;
+	durationUs = 0;
+	step = updates = late = 0;
+	startTick = lastTick = 0;
+	up = running = false;
+}
+
+/*
+ * Steps of at least RAMP_MIN_STEP_US on whole ticker periods. Of the
+ * step counts between half and all of what fits, take the one whose
+ * total comes closest to the requested length (5 ms: 25 x 200 us).
+ */
+void ToneRamp :: Begin ( uint16_t duration, uint8_t level ) {
+	if ( duration < RAMP_MIN_US ) duration = RAMP_MIN_US;
+	if ( duration > RAMP_MAX_US ) duration = RAMP_MAX_US;
+	durationUs = duration;
+	this->level = level > RAMP_SILENT ? RAMP_SILENT : level;
+
+	uint32_t total = (uint32_t)duration * HAL_CYCLES_PER_US / HAL_TICKER_CYCLES;
+	uint8_t most = duration / RAMP_MIN_STEP_US > RAMP_TABLE_STEPS ?
+		RAMP_TABLE_STEPS : duration / RAMP_MIN_STEP_US;
+	uint16_t bestError = 0xFFFF;
+	for ( uint8_t n = most; n >= most / 2 && n > 0; n-- ) {
+		uint32_t ticks = (total + n / 2) / n;
+		if ( ticks < 1 ) ticks = 1;
+		if ( ticks > HAL_TICKER_MAX_TICKS ) break;
+		uint32_t length = ticks * n;
+		uint16_t error = length > total ? length - total : total - length;
+		if ( error < bestError ) {
+			bestError = error;
+			steps = n;
+			period = ticks;
+		}
+	}
+}
+
+void ToneRamp :: Start ( bool up ) {
+	HalIrqState state = halIrqSave();
+	this->up = up;
+	step = updates = late = 0;
+	lastAttenuation = up ? RAMP_SILENT : level;
+	startTick = lastTick = halTimerNow();
+	running = true;
+	halTickerStart(period);
+	halIrqRestore(state);
+}
+
+void ToneRamp :: Cancel ( void ) {
+	HalIrqState state = halIrqSave();
+	halTickerStop();
+	running = false;
+	halIrqRestore(state);
+}
+
+/*
+ * One table step per tick. After the last one keep ticking until the
+ * queue is empty, so the caller's stop words can use the bus.
+ */
+bool ToneRamp :: Step ( void ) {
+	if ( !running ) return false;
+
+	if ( step < steps ) {
+		if ( halI2cPending() >= HAL_I2C_QUEUE_ROOM ) {
+			late++;
+			return false;
+		}
+		step++;
+		uint8_t a = Attenuation(up ? step : steps - step);
+		if ( a != lastAttenuation ) {
+			volume.attenuation(channel, a);
+			lastAttenuation = a;
+			updates++;
+		}
+		if ( step == steps ) lastTick = halTimerNow();
+		return false;
+	}
+
+	if ( halI2cPending() ) return false;
+	halTickerStop();
+	running = false;
+	return true;
+}
+
+// --------------------- PRIVATE FUNCTIONS --------------------------
+
+/*
+ * Attenuation at position 0 (silent) .. steps (full level)
+ */
+uint8_t ToneRamp :: Attenuation ( uint8_t position ) {
+	uint8_t extra;
+	uint8_t index = ((uint16_t)position * RAMP_TABLE_STEPS + steps / 2) / steps;
+	halFlashRead(&extra, &rampTable[index], 1);
+	uint16_t a = (uint16_t)level + extra;
+	return a > RAMP_SILENT ? RAMP_SILENT : a;
+}
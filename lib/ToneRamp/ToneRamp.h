@@ -0,0 +1,97 @@
+/*
+ * ToneRamp.h
+ *
+ * Raised-cosine (cos^2) onset and offset ramps on a PT2258 channel. The
+ * amplitude follows sin^2(pi/2 * t / T) up and cos^2 down; the matching
+ * attenuation in dB is a 33 point table in flash, added to the channel's
+ * full level and clamped at the PT2258's 79 dB.
+ *
+ * Steps are paced by the Timer2 ticker (HAL_TICKER_ISR) and queued on the
+ * HAL I2C queue, so neither the ramp nor its bus traffic holds up loop():
+ *
+ *	pt2258.setAsync(true);
+ *	ramp.Begin(5000, level);		// 5 ms ramps to level dB
+ *	...
+ *	ramp.Start(true);				// onset, e.g. from the trigger ISR
+ *
+ *	HAL_TICKER_ISR {
+ *		if ( ramp.Step() && !ramp.IsUp() ) ... stop words ...
+ *	}
+ *
+ * The PT2258 must be in queued mode and the HAL must use its own TWI
+ * engine (not HAL_I2C_WIRE): a blocking write from the ticker ISR would
+ * never complete. A step that finds the queue full is retried on the next
+ * tick and counted in LateSteps().
+ *
+ * Each ramp is measured on Timer1 (ToneGate::Begin must have run) from
+ * Start() to the last write queued; MeasuredMicros() and Updates() report
+ * its timing and its I2C traffic.
+ */
+
+#ifndef ToneRamp_h
+#define ToneRamp_h
+
+#include "Hal.h"
+#include "PT2258.h"
+
+#define RAMP_SILENT			79			// PT2258 maximum attenuation
+#define RAMP_TABLE_STEPS	32			// table points - 1
+#define RAMP_MIN_US			1000
+#define RAMP_MAX_US			20000
+#define RAMP_MIN_STEP_US	100			// a queued 2 byte write at 400 kHz is ~75 us
+
+class ToneRamp {
+
+public:
+
+	ToneRamp ( PT2258 &pt2258, uint8_t channel );
+
+	// Ramp length (RAMP_MIN_US - RAMP_MAX_US) and the attenuation in dB
+	// at full level. Picks up to RAMP_TABLE_STEPS steps on ticker periods
+	void Begin ( uint16_t durationUs, uint8_t level );
+
+	// Change the full level for the next Start(). Safe from an ISR
+	void SetLevel ( uint8_t level ) {
+		this->level = level > RAMP_SILENT ? RAMP_SILENT : level;
+	}
+
+	// Start a rise (up) or fall from the other end. Safe from an ISR
+	void Start ( bool up );
+
+	// Stop without finishing the ramp
+	void Cancel ( void );
+
+	// Called from HAL_TICKER_ISR. Returns true once, when the last step's
+	// write has left the I2C queue
+	bool Step ( void );
+
+	bool IsRunning ( void ) const { return running; }
+	bool IsUp ( void ) const { return up; }
+
+	uint8_t Steps ( void ) const { return steps; }
+	uint16_t StepMicros ( void ) const {
+		return (uint32_t)period * HAL_TICKER_CYCLES / HAL_CYCLES_PER_US;
+	}
+	uint16_t DurationMicros ( void ) const { return durationUs; }
+
+	// Last ramp: attenuation writes queued, steps delayed by a full queue,
+	// and the time from Start() to the last write queued
+	uint8_t Updates ( void ) const { return updates; }
+	uint8_t LateSteps ( void ) const { return late; }
+	uint16_t MeasuredMicros ( void ) const {
+		return (uint16_t)(lastTick - startTick) / HAL_TIMER_TICKS_PER_US;
+	}
+
+private:
+
+	uint8_t			Attenuation ( uint8_t position );
+
+	PT2258			&volume;
+	uint8_t			channel, level, steps, lastAttenuation;
+	uint16_t		period, durationUs;		// ticker ticks, us
+	volatile uint8_t	step, updates, late;
+	volatile uint16_t	startTick, lastTick;
+	volatile bool	up, running;
+};
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ * ToneSequence.cpp
+ *
+ * Flash resident stimulus sequences. See ToneSequence.h for an overview.
+ */
+
+#include "ToneSequence.h"
+
+ToneSequence :: ToneSequence ( uint8_t fsyncPin ) {
+	fsync = halPin(fsyncPin);
+	next = 0;
+	word = 0;
+	frac = 0;
+	delta = 0;
+	stepTicks = stepsLeft = control = 0;
+	mode = SEQ_MODE_END;
+	running = false;
+	ResetStats();
+}
+
+/*
+ * Write the first step right away and schedule the second one. The
+ * caller's onset word follows, so the first segment starts with it.
+ */
+void ToneSequence :: Start ( const SeqSegment *table ) {
+	HalIrqState state = halIrqSave();
+	next = table;
+	control = 0;					// first segment: keep the onset control word
+	running = LoadSegment();
+	if ( running ) {
+		halTimerSetCompareB(halTimerNow() + stepTicks);
+		halTimerCompareBEnable(true);
+	}
+	halIrqRestore(state);
+}
+
+void ToneSequence :: Stop ( void ) {
+	HalIrqState state = halIrqSave();
+	halTimerCompareBEnable(false);
+	running = false;
+	halIrqRestore(state);
+}
+
+/*
+ * One update. Integer math only: LINEAR adds delta, LOG adds
+ * word * delta / 2^32 from 16 x 16 bit products, so nothing overflows 32
+ * bits. The bits below the word carry over in frac instead of being
+ * truncated every step.
+ */
+void ToneSequence :: Step ( void ) {
+	uint16_t due = halTimerCompareB();
+
+	if ( stepsLeft ) {
+		stepsLeft--;
+		if ( mode == SEQ_MODE_LINEAR ) {
+			word += delta;
+			WriteWord();
+		}
+		else if ( mode == SEQ_MODE_LOG ) {
+			uint16_t w1 = word >> 16, w0 = word;
+			int16_t d1 = delta >> 16;
+			uint16_t d0 = delta;
+			int32_t mid0 = (int32_t)w0 * d1;
+			uint32_t mid1 = (uint32_t)w1 * d0;
+			int32_t low = (int32_t)frac + (mid0 & 0xFFFF) + (mid1 & 0xFFFF) +
+				(((uint32_t)w0 * d0) >> 16) + (((int32_t)frac * d1) >> 16);
+			word += (int32_t)w1 * d1 + (mid0 >> 16) + (int32_t)(mid1 >> 16) +
+				(low >> 16);
+			frac = low;
+			WriteWord();
+		}
+	}
+	else if ( !LoadSegment() ) {
+		halTimerCompareBEnable(false);
+		running = false;
+		return;
+	}
+
+	uint16_t at = due + stepTicks;
+	halTimerSetCompareB(at);
+	uint16_t now = halTimerNow();
+	if ( (int16_t)(now - at) >= 0 ) {		// next step already due
+		overruns++;
+		halTimerSetCompareB(now + SEQ_MIN_STEP_TICKS);
+	}
+	uint16_t service = now - due;
+	if ( service > maxService ) maxService = service;
+}
+
+void ToneSequence :: ResetStats ( void ) {
+	maxService = overruns = 0;
+}
+
+// --------------------- PRIVATE FUNCTIONS --------------------------
+
+/*
+ * Copy the next segment out of flash and write its first word. Returns
+ * false at SEQ_END.
+ */
+bool ToneSequence :: LoadSegment ( void ) {
+	SeqSegment s;
+	halFlashRead(&s, next, sizeof(s));
+	if ( s.mode == SEQ_MODE_END || !s.steps ) return false;
+	next++;
+
+	if ( control && s.control != control ) {
+		halPinLow(fsync);
+		halSpiWriteRaw(highByte(s.control));
+		halSpiWriteRaw(lowByte(s.control));
+		halPinHigh(fsync);
+	}
+	control = s.control;
+	mode = s.mode;
+	word = s.freqWord & 0x0FFFFFFFUL;
+	frac = 0;
+	delta = s.delta;
+	stepTicks = s.stepTicks < SEQ_MIN_STEP_TICKS ? SEQ_MIN_STEP_TICKS : s.stepTicks;
+	stepsLeft = s.steps - 1;
+	WriteWord();
+	return true;
+}
+
+/*
+ * FREQ0 LSB then MSB. The AD9833 takes the new word after the MSB
+ */
+void ToneSequence :: WriteWord ( void ) {
+	uint16_t lsb = FREQ0_WRITE_REG | (uint16_t)(word & 0x3FFF);
+	uint16_t msb = FREQ0_WRITE_REG | (uint16_t)((word >> 14) & 0x3FFF);
+	halPinLow(fsync);
+	halSpiWriteRaw(highByte(lsb));
+	halSpiWriteRaw(lowByte(lsb));
+	halPinHigh(fsync);
+	halPinLow(fsync);
+	halSpiWriteRaw(highByte(msb));
+	halSpiWriteRaw(lowByte(msb));
+	halPinHigh(fsync);
+}
@@ -0,0 +1,199 @@
+/*
+ * ToneSequence.h
+ *
+ * Flash resident stimulus sequences: frequency steps, linear and
+ * logarithmic sweeps (FM chirps) and multi-segment tones, played by the
+ * Timer1 compare B interrupt while ToneGate keeps compare A for the
+ * offset.
+ *
+ * A sequence is a HAL_FLASH (PROGMEM) array of SeqSegment records built
+ * at compile time with the constexpr helpers below, so neither the table
+ * nor any float math costs SRAM or time on the board:
+ *
+ *	const SeqSegment sweep[] HAL_FLASH = {
+ *		seqLinear(4000, 16000, 200000, 500),	// 4 - 16 kHz, 200 ms, 2 kHz rate
+ *		seqTone(16000, 150000),					// hold 150 ms
+ *		SEQ_END
+ *	};
+ *
+ *	HAL_TIMER_COMPARE_B_ISR { sequence.Step(); }
+ *
+ * Every step writes FREQ0 as an LSB / MSB pair. With B28 set the AD9833
+ * only updates the register after the MSB, so the output never sees a
+ * half written word. A control word is written only when the waveform
+ * changes between segments; the first segment plays with the control
+ * word of the onset (e.g. the TriggerPlan one), so its waveform must
+ * match it.
+ *
+ * The engine measures itself: MaxServiceTicks() is the longest time from
+ * a scheduled step to the end of its ISR, and MaxUpdateRateHz() the step
+ * rate that leaves no slack at that service time.
+ */
+
+#ifndef ToneSequence_h
+#define ToneSequence_h
+
+#include "Hal.h"
+#include "AD9833Words.h"
+
+#define SEQ_TICKS_PER_US		HAL_TIMER_TICKS_PER_US
+#define SEQ_MIN_STEP_TICKS		64			// 32 us: the ISR needs ~15 us
+#define SEQ_MAX_STEP_TICKS		60000U		// holds longer than this are split
+#define SEQ_START_WORDS			2			// FREQ0 LSB, MSB from Start()
+
+typedef enum {
+	SEQ_MODE_END,			// end of the table
+	SEQ_MODE_HOLD,			// one frequency for steps * stepTicks
+	SEQ_MODE_LINEAR,		// word += delta every step
+	SEQ_MODE_LOG			// word *= 1 + delta / 2^32 every step
+} SeqMode;
+
+struct SeqSegment {
+	uint32_t	freqWord;		// tuning word of the first step
+	int32_t		delta;			// LINEAR: words per step, LOG: Q32 ratio - 1
+	uint16_t	stepTicks;		// Timer1 ticks between steps
+	uint16_t	steps;			// updates in the segment (>= 1)
+	uint16_t	control;		// waveform control word (no RESET)
+	uint8_t		mode;
+};
+
+#define SEQ_END		{ 0, 0, 0, 0, 0, SEQ_MODE_END }
+
+// --------------------- Compile-time segment builders ----------------------
+
+constexpr uint32_t seqTicks ( uint32_t us ) {
+	return us * SEQ_TICKS_PER_US;
+}
+
+constexpr uint16_t seqStepTicks ( uint32_t stepUs ) {
+	return seqTicks(stepUs) < SEQ_MIN_STEP_TICKS ? SEQ_MIN_STEP_TICKS :
+		seqTicks(stepUs) > SEQ_MAX_STEP_TICKS ? SEQ_MAX_STEP_TICKS :
+		(uint16_t)seqTicks(stepUs);
+}
+
+constexpr uint16_t seqSteps ( uint32_t durationUs, uint32_t stepUs ) {
+	return durationUs / stepUs < 1 ? 1 :
+		durationUs / stepUs > 0xFFFF ? 0xFFFF : (uint16_t)(durationUs / stepUs);
+}
+
+// Hold: split into equal steps of at most SEQ_MAX_STEP_TICKS
+constexpr uint16_t seqHoldSteps ( uint32_t durationUs ) {
+	return (uint16_t)((seqTicks(durationUs) + SEQ_MAX_STEP_TICKS - 1) /
+		SEQ_MAX_STEP_TICKS);
+}
+
+constexpr SeqSegment seqTone ( uint32_t frequencyInHz, uint32_t durationUs,
+		WaveformType waveType = SINE_WAVE,
+		uint32_t referenceFrequency = 25000000UL ) {
+	return SeqSegment { ad9833FreqWord(frequencyInHz, referenceFrequency), 0,
+		seqStepTicks(durationUs / seqHoldSteps(durationUs)),
+		seqHoldSteps(durationUs), ad9833Control(waveType), SEQ_MODE_HOLD };
+}
+
+// Linear sweep from startHz towards endHz, one update every stepUs
+constexpr SeqSegment seqLinear ( uint32_t startHz, uint32_t endHz,
+		uint32_t durationUs, uint32_t stepUs,
+		WaveformType waveType = SINE_WAVE,
+		uint32_t referenceFrequency = 25000000UL ) {
+	return SeqSegment { ad9833FreqWord(startHz, referenceFrequency),
+		(int32_t)(((int64_t)ad9833FreqWord(endHz, referenceFrequency) -
+			(int64_t)ad9833FreqWord(startHz, referenceFrequency)) /
+			seqSteps(durationUs, stepUs)),
+		seqStepTicks(stepUs), seqSteps(durationUs, stepUs),
+		ad9833Control(waveType), SEQ_MODE_LINEAR };
+}
+
+// Q32 products saturate here, far above any frequency ratio, so the
+// bisection below can overshoot without overflowing 64 bits
+#define SEQ_Q32_MAX		(1ULL << 60)
+
+// a * b for Q32 values, in 32 bit halves
+constexpr uint64_t seqMulQ32 ( uint64_t a, uint64_t b ) {
+	return a > SEQ_Q32_MAX || b > SEQ_Q32_MAX ||
+		(a >> 32) * (b >> 32) >= (1ULL << 28) ? SEQ_Q32_MAX + 1 :
+		((a >> 32) * (b >> 32) << 32) + (a >> 32) * (b & 0xFFFFFFFFUL) +
+		(a & 0xFFFFFFFFUL) * (b >> 32) +
+		((a & 0xFFFFFFFFUL) * (b & 0xFFFFFFFFUL) >> 32);
+}
+
+// r^n for a Q32 ratio, by squaring
+constexpr uint64_t seqPowQ32 ( uint64_t r, uint16_t n ) {
+	return n == 0 ? 1ULL << 32 :
+		n % 2 ? seqMulQ32(r, seqPowQ32(r, n - 1)) :
+		seqPowQ32(seqMulQ32(r, r), n / 2);
+}
+
+// Largest Q32 ratio in [lo, hi) with ratio^n <= target (bisection)
+constexpr uint64_t seqRootQ32 ( uint64_t target, uint16_t n,
+		uint64_t lo, uint64_t hi ) {
+	return hi - lo <= 1 ? lo :
+		seqPowQ32((lo + hi) / 2, n) <= target ?
+			seqRootQ32(target, n, (lo + hi) / 2, hi) :
+			seqRootQ32(target, n, lo, (lo + hi) / 2);
+}
+
+// Logarithmic sweep: the same frequency ratio every stepUs. The ratio
+// per step must stay within 0.5 - 1.5. It is Q32, so its rounding does
+// not add up to an audible error over thousands of steps
+constexpr SeqSegment seqLog ( uint32_t startHz, uint32_t endHz,
+		uint32_t durationUs, uint32_t stepUs,
+		WaveformType waveType = SINE_WAVE,
+		uint32_t referenceFrequency = 25000000UL ) {
+	return SeqSegment { ad9833FreqWord(startHz, referenceFrequency),
+		(int32_t)((int64_t)seqRootQ32(((uint64_t)endHz << 32) / startHz,
+			seqSteps(durationUs, stepUs), 1ULL << 31, 3ULL << 31) -
+			(1LL << 32)),
+		seqStepTicks(stepUs), seqSteps(durationUs, stepUs),
+		ad9833Control(waveType), SEQ_MODE_LOG };
+}
+
+// --------------------- Engine ----------------------
+
+class ToneSequence {
+
+public:
+
+	// AD9833 on fsyncPin; SPI must be set up for it (TriggerPlan::Arm)
+	ToneSequence ( uint8_t fsyncPin );
+
+	// Load the first segment of a HAL_FLASH table into FREQ0 and start
+	// stepping. Safe from an ISR; call before the onset word
+	void Start ( const SeqSegment *table );
+
+	// Stop stepping, e.g. from the offset ISR
+	void Stop ( void );
+
+	// Called from HAL_TIMER_COMPARE_B_ISR
+	void Step ( void );
+
+	bool IsRunning ( void ) const { return running; }
+
+	// Longest scheduled-step to ISR-exit time in Timer1 ticks, and the
+	// highest step rate that service time allows
+	uint16_t MaxServiceTicks ( void ) const { return maxService; }
+	uint32_t MaxUpdateRateHz ( void ) const {
+		return maxService ? 1000000UL * SEQ_TICKS_PER_US / maxService : 0;
+	}
+
+	// Steps that were due before the previous one had finished
+	uint16_t Overruns ( void ) const { return overruns; }
+
+	void ResetStats ( void );
+
+private:
+
+	bool			LoadSegment ( void );
+	void			WriteWord ( void );
+
+	HalPin			fsync;
+	const SeqSegment	*next;			// next segment in flash
+	uint32_t		word;
+	uint16_t		frac;			// LOG: word bits below the LSB, / 2^16
+	int32_t			delta;
+	uint16_t		stepTicks, stepsLeft, control;
+	uint8_t			mode;
+	volatile bool	running;
+	volatile uint16_t	maxService, overruns;
+};
+
+#endif
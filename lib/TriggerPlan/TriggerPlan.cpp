@@ -0,0 +1,196 @@
+/*
+ * TriggerPlan.cpp
+ *
+ * Pre-armed stimulus command plan for the AD9833 / PT2258 tone path.
+ * See TriggerPlan.h for an overview.
+ */
+
+#include <math.h>
+#include "TriggerPlan.h"
+#include "PT2258.h"
+
+/*
+ * Create a plan for an AD9833 on fsyncPin and a PT2258 at the given
+ * 8 bit address (see PT2258.cpp for the address table).
+ */
+TriggerPlan :: TriggerPlan ( uint8_t fsyncPin, uint8_t pt2258Address,
+		uint32_t referenceFrequency ) {
+	fsync = halPin(fsyncPin);
+	address = pt2258Address >> 1;
+	refFrequency = referenceFrequency;
+	arm.count = onset.count = offset.count = 0;
+	armed = fired = false;
+	levelsSent = false;
+	preFireWords = 0;
+	i2cErrors = 0;
+}
+
+/*
+ * Convert a stimulus in Hz and degrees into register words (the float
+ * path; fixed stimuli can use AD9833Words<> instead) and compile it.
+ */
+void TriggerPlan :: Compile ( const StimulusSpec &spec ) {
+	float frequency = spec.frequencyInHz;
+	if ( frequency > 12.5e6 ) frequency = 12.5e6;
+	if ( frequency < 0.0 ) frequency = 0.0;
+	uint32_t freqWord = (frequency * pow2_28) / (float)refFrequency;
+
+	float phaseInDeg = fmod(spec.phaseInDeg,360);
+	if ( phaseInDeg < 0 ) phaseInDeg += 360;
+	uint16_t phaseVal = (uint16_t)(BITS_PER_DEG * phaseInDeg) & 0x0FFF;
+
+	StimulusWords words;
+	words.control = (uint16_t)spec.waveType;	// FREQ0 / PHASE0, B28 set
+	words.freqLsb = FREQ0_WRITE_REG | (uint16_t)(freqWord & 0x3FFF);
+	words.freqMsb = FREQ0_WRITE_REG | (uint16_t)((freqWord >> 14) & 0x3FFF);
+	words.phase = PHASE_WRITE_CMD | phaseVal;
+	words.channel = spec.channel;
+	words.attenuation = spec.attenuation;
+	words.muteBetweenTrials = spec.muteBetweenTrials;
+	Compile(words);
+}
+
+/*
+ * Compile the stimulus into the step tables. Only REG0 is used; the
+ * control word keeps RESET set in the arm and offset tables so the
+ * AD9833 outputs midscale until the onset table clears it.
+ */
+void TriggerPlan :: Compile ( const StimulusWords &spec ) {
+	arm.count = onset.count = offset.count = 0;
+	levelsSent = false;
+
+	uint16_t control = spec.control & ~RESET_CMD;
+
+	// Arm: hold in RESET, load FREQ0 and PHASE0, set the volume
+	AddSPI(arm, control | RESET_CMD);
+	AddSPI(arm, spec.freqLsb);
+	AddSPI(arm, spec.freqMsb);
+	AddSPI(arm, spec.phase);
+
+	uint8_t channel = spec.channel < 1 ? 0 : spec.channel > 6 ? 5 : spec.channel - 1;
+	uint8_t attenuation = spec.attenuation > 79 ? 79 : spec.attenuation;
+	static const uint8_t ch10[6] = { PT2258_CH1_10, PT2258_CH2_10,
+		PT2258_CH3_10, PT2258_CH4_10, PT2258_CH5_10, PT2258_CH6_10 };
+	static const uint8_t ch1[6] = { PT2258_CH1_1, PT2258_CH2_1,
+		PT2258_CH3_1, PT2258_CH4_1, PT2258_CH5_1, PT2258_CH6_1 };
+	AddI2C(arm, PLAN_I2C_PAIR, ch10[channel] + attenuation / 10,
+		ch1[channel] + attenuation % 10);
+
+	// With the AD9833 in RESET the DAC sits at midscale, so the PT2258 can
+	// stay unmuted between trials and the onset is a single SPI word.
+	if ( spec.muteBetweenTrials ) {
+		AddI2C(arm, PLAN_I2C_BYTE, PT2258_CHALL_MUTE + 1, 0);
+		AddI2C(onset, PLAN_I2C_BYTE, PT2258_CHALL_MUTE, 0);
+	}
+	else
+		AddI2C(arm, PLAN_I2C_BYTE, PT2258_CHALL_MUTE, 0);
+
+	// Onset: release RESET. Offset: back into RESET, then mute
+	AddSPI(onset, control);
+	AddSPI(offset, control | RESET_CMD);
+	if ( spec.muteBetweenTrials )
+		AddI2C(offset, PLAN_I2C_BYTE, PT2258_CHALL_MUTE + 1, 0);
+}
+
+/*
+ * Send the arm table and enable the ISR path. Must be called from loop();
+ * waits for queued I2C writes first, and nothing may be queued while
+ * armed, since the ISR drives the TWI directly. The SPI settings of the arm
+ * transaction stay in SPCR for the ISR, so other SPI users must not run
+ * between Arm() and the trigger.
+ */
+bool TriggerPlan :: Arm ( void ) {
+	bool levelsWritten = !levelsSent;
+	halI2cFlush();
+	halSpiBeginTransaction(AD9833_SPI_CLOCK, HAL_SPI_MODE2);
+	if ( levelsSent ) {
+		// Re-arm: the PT2258 still holds the arm levels
+		for ( uint8_t i = 0; i < arm.count; i++ )
+			if ( arm.step[i].bus == PLAN_SPI_WORD ) PlayStep(arm.step[i]);
+	}
+	else {
+		uint8_t errors = i2cErrors;
+		Play(arm);
+		levelsSent = i2cErrors == errors;
+	}
+	halSpiEndTransaction();
+	HalIrqState state = halIrqSave();
+	fired = false;
+	armed = true;
+	halIrqRestore(state);
+	return levelsWritten;
+}
+
+void TriggerPlan :: Disarm ( void ) {
+	armed = false;
+}
+
+bool TriggerPlan :: TakeFired ( void ) {
+	HalIrqState state = halIrqSave();
+	bool f = fired;
+	fired = false;
+	halIrqRestore(state);
+	return f;
+}
+
+/*
+ * Worst case from the trigger edge to the end of the onset table:
+ * interrupt response + the longest interrupts-off section of the core
+ * + the bus time of every onset step at the current SPI/TWI clocks.
+ */
+uint32_t TriggerPlan :: OnsetBoundCycles ( void ) const {
+	uint32_t cycles = PLAN_ISR_ENTRY_CYCLES + PLAN_ISR_BLOCKING_CYCLES +
+		(uint32_t)preFireWords * SpiWordCycles();
+	for ( uint8_t i = 0; i < onset.count; i++ )
+		cycles += StepCycles(onset.step[i]);
+	return cycles;
+}
+
+/*
+ * Interrupt response + the first offset step, which RESETs the AD9833.
+ * A mute byte after it does not change when the tone stops.
+ */
+uint16_t TriggerPlan :: OffsetLeadCycles ( void ) const {
+	if ( !offset.count ) return 0;
+	return PLAN_ISR_ENTRY_CYCLES + StepCycles(offset.step[0]);
+}
+
+// --------------------- PRIVATE FUNCTIONS --------------------------
+
+void TriggerPlan :: AddSPI ( PlanTable &table, uint16_t word ) {
+	if ( table.count >= PLAN_MAX_STEPS ) return;
+	PlanStep &s = table.step[table.count++];
+	s.bus = PLAN_SPI_WORD;
+	s.b0 = highByte(word);
+	s.b1 = lowByte(word);
+}
+
+void TriggerPlan :: AddI2C ( PlanTable &table, uint8_t bus, uint8_t a, uint8_t b ) {
+	if ( table.count >= PLAN_MAX_STEPS ) return;
+	PlanStep &s = table.step[table.count++];
+	s.bus = bus;
+	s.b0 = a;
+	s.b1 = b;
+}
+
+/*
+ * Polled TWI write, so this can run inside the trigger ISR
+ */
+void TriggerPlan :: WriteI2C ( const PlanStep &s ) {
+	uint8_t n = s.bus == PLAN_I2C_PAIR ? 2 : 1;
+	if ( halI2cWriteRaw(address, &s.b0, n) != 0 ) i2cErrors++;
+}
+
+/*
+ * Bus time of one step in CPU cycles at the current clock settings
+ */
+uint16_t TriggerPlan :: StepCycles ( const PlanStep &s ) const {
+	if ( s.bus == PLAN_SPI_WORD ) return SpiWordCycles();
+	// START + SLA+W (9 bits) + 9 bits per data byte + STOP
+	uint8_t bits = s.bus == PLAN_I2C_PAIR ? 29 : 20;
+	return bits * halI2cBitCycles();
+}
+
+uint16_t TriggerPlan :: SpiWordCycles ( void ) const {
+	return 2 * halSpiByteCycles() + 16;		// + FSYNC and SPIF polling
+}
@@ -0,0 +1,190 @@
+/*
+ * TriggerPlan.h
+ *
+ * Pre-armed stimulus command plan for the AD9833 / PT2258 tone path.
+ *
+ * At arm time the complete onset sequence is compiled into fixed tables
+ * of raw AD9833 register words and PT2258 I2C bytes. Everything that can
+ * be written ahead of the trigger (frequency, phase, waveform, volume) is
+ * sent once from loop(). The trigger ISR then only plays the short onset
+ * table - normally a single 16-bit control word that releases the AD9833
+ * from RESET - using direct SPI/TWI register access.
+ *
+ * The tables are plain data, so the worst-case trigger-to-sound time can
+ * be bounded from the step list alone (see OnsetBoundCycles()).
+ */
+
+#ifndef TriggerPlan_h
+#define TriggerPlan_h
+
+#include "Hal.h"
+#include "AD9833.h"
+
+#define PLAN_MAX_STEPS		8
+
+/*
+ * Worst-case interrupt response used for the latency bound, in CPU cycles:
+ * 4 cycles hardware response + 4 cycles to finish the current instruction
+ * + JMP from the vector table + ISR prologue.
+ */
+#define PLAN_ISR_ENTRY_CYCLES		32
+/*
+ * Longest stretch interrupts stay disabled while armed, in CPU cycles.
+ * INT1 has the highest priority after INT0 and AVR ISRs do not nest, so
+ * only the single longest section counts. Hand-counted from the C
+ * source and rounded up, not measured or read off a disassembly:
+ *
+ *	TIMER0_OVF (millis()), USART RX / UDRE			~100
+ *	TIMER1_OVF, 64-bit overflow count				~90
+ *	StimulusSelect::Prepare() in loop(), 2 words	~160
+ *	EventLog::Push(), ProbeHistogram::Record()		~90
+ *	TWI_vect completing a queued PT2258 write:		~240
+ *	  prologue for the callback, STOP busy-wait (one SCL period at
+ *	  400 kHz), PT2258::done(), StartNext()
+ *	  + PROBE_END in PT2258::done() with -DPROBES	+90
+ *
+ * The TWI completion is the longest, e.g. a selectLevel() queued while
+ * armed. Recount when a section is added or the I2C clock drops below
+ * 400 kHz.
+ */
+#ifdef PROBES
+#define PLAN_ISR_BLOCKING_CYCLES	330
+#else
+#define PLAN_ISR_BLOCKING_CYCLES	240
+#endif
+
+typedef enum {
+	PLAN_SPI_WORD,		// 16-bit AD9833 word, framed by FSYNC
+	PLAN_I2C_BYTE,		// single PT2258 command byte (mute)
+	PLAN_I2C_PAIR		// PT2258 10 dB / 1 dB attenuation pair
+} PlanBus;
+
+struct PlanStep {
+	uint8_t		bus;
+	uint8_t		b0, b1;		// SPI: high, low byte. I2C: first, second byte
+};
+
+struct PlanTable {
+	PlanStep	step[PLAN_MAX_STEPS];
+	uint8_t		count;
+};
+
+struct StimulusSpec {
+	WaveformType	waveType;
+	float			frequencyInHz;
+	float			phaseInDeg;
+	uint8_t			channel;			// PT2258 channel, 1 - 6
+	uint8_t			attenuation;		// 0 (loudest) - 79 dB
+	bool			muteBetweenTrials;	// unmute from the ISR (+1 I2C byte)
+};
+
+/*
+ * The same stimulus as raw AD9833 words, e.g. from AD9833Words<>, so a
+ * fixed stimulus compiles without any float math on the board.
+ */
+struct StimulusWords {
+	uint16_t		control;			// control word without RESET
+	uint16_t		freqLsb, freqMsb;	// FREQ0 writes
+	uint16_t		phase;				// PHASE0 write
+	uint8_t			channel;
+	uint8_t			attenuation;
+	bool			muteBetweenTrials;
+};
+
+class TriggerPlan {
+
+public:
+
+	TriggerPlan ( uint8_t fsyncPin, uint8_t pt2258Address,
+		uint32_t referenceFrequency = 25000000UL );
+
+	// Build the arm / onset / offset tables for a stimulus
+	void Compile ( const StimulusSpec &spec );
+	void Compile ( const StimulusWords &words );
+
+	// Send the arm table from loop() and enable the ISR path. The PT2258
+	// steps only go out on the first Arm() after Compile() or Invalidate():
+	// the offset table leaves the volume and mute as the arm table set them.
+	// Returns true when they did; they bypass the PT2258 driver, so its
+	// shadow no longer matches the chip (PT2258::invalidate())
+	bool Arm ( void );
+
+	// Send the full arm table again on the next Arm(), e.g. after
+	// something else wrote to the PT2258
+	void Invalidate ( void ) { levelsSent = false; }
+
+	// Stop the ISR path. The caller restores the driver state
+	void Disarm ( void );
+
+	// Called from the trigger ISR. Returns true if the onset was played
+	inline bool Fire ( void ) {
+		if ( !armed ) return false;
+		Play(onset);
+		armed = false;
+		fired = true;
+		return true;
+	}
+
+	// Play the offset table (RESET the AD9833, optionally mute)
+	void Stop ( void ) { Play(offset); }
+
+	bool IsArmed ( void ) const { return armed; }
+
+	// Returns and clears the "onset played" flag set by Fire()
+	bool TakeFired ( void );
+
+	// SPI words the trigger ISR may write before Fire(): a select miss or
+	// a sequence's first FREQ0 step. Counted in OnsetBoundCycles()
+	void SetPreFireWords ( uint8_t words ) { preFireWords = words; }
+
+	// Upper bound from the trigger edge to the last onset bit, in cycles
+	uint32_t OnsetBoundCycles ( void ) const;
+
+	// Estimate from a compare match to the end of the RESET word in the
+	// offset table, in cycles. Hand-counted like the onset bound
+	uint16_t OffsetLeadCycles ( void ) const;
+
+	// Number of I2C transfers from the ISR that were not ACKed
+	uint8_t I2CErrors ( void ) const { return i2cErrors; }
+
+	const PlanTable &ArmTable ( void ) const { return arm; }
+	const PlanTable &OnsetTable ( void ) const { return onset; }
+	const PlanTable &OffsetTable ( void ) const { return offset; }
+
+	// Play a table with direct register access. Safe from an ISR as long
+	// as the I2C queue is empty (guaranteed while armed).
+	inline void Play ( const PlanTable &table ) {
+		for ( uint8_t i = 0; i < table.count; i++ )
+			PlayStep(table.step[i]);
+	}
+
+	inline void PlayStep ( const PlanStep &s ) {
+		if ( s.bus == PLAN_SPI_WORD ) {
+			halPinLow(fsync);
+			halSpiWriteRaw(s.b0);
+			halSpiWriteRaw(s.b1);
+			halPinHigh(fsync);
+		}
+		else
+			WriteI2C(s);
+	}
+
+private:
+
+	void			AddSPI ( PlanTable &table, uint16_t word );
+	void			AddI2C ( PlanTable &table, uint8_t bus, uint8_t a, uint8_t b );
+	void			WriteI2C ( const PlanStep &s );
+	uint16_t		StepCycles ( const PlanStep &s ) const;
+	uint16_t		SpiWordCycles ( void ) const;
+
+	PlanTable		arm, onset, offset;
+	HalPin			fsync;
+	uint8_t			address;		// PT2258, 7 bit
+	uint32_t		refFrequency;
+	volatile bool	armed, fired;
+	bool			levelsSent;
+	uint8_t			preFireWords;
+	volatile uint8_t	i2cErrors;
+};
+
+#endif
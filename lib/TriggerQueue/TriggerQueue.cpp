@@ -0,0 +1,60 @@
+/*
+ * TriggerQueue.cpp
+ *
+ * Trigger event ring with retrigger policies. See TriggerQueue.h for an
+ * overview.
+ */
+
+#include "TriggerQueue.h"
+
+#define TRIGGER_QUEUE_MASK	(TRIGGER_QUEUE_SIZE - 1)
+
+TriggerQueue :: TriggerQueue ( uint8_t policy ) {
+	head = tail = 0;
+	queued = dropped = coalesced = 0;
+	this->policy = policy;
+}
+
+uint8_t TriggerQueue :: Offer ( const TriggerEvent &event, bool busy ) {
+	if ( busy ) {
+		if ( policy == TRIGGER_DROP ) {
+			dropped++;
+			return TRIGGER_DROPPED;
+		}
+		if ( policy == TRIGGER_RESTART && !IsEmpty() ) {
+			coalesced++;
+			return TRIGGER_COALESCED;
+		}
+	}
+	if ( !Push(event) ) {
+		dropped++;
+		return TRIGGER_DROPPED;
+	}
+	queued++;
+	return TRIGGER_QUEUED;
+}
+
+/*
+ * Copy the oldest event out, then release its slot
+ */
+bool TriggerQueue :: Take ( TriggerEvent &event ) {
+	uint8_t t = tail;
+	if ( t == head ) return false;
+	event = ring[t];
+	tail = (t + 1) & TRIGGER_QUEUE_MASK;
+	return true;
+}
+
+// --------------------- PRIVATE FUNCTIONS --------------------------
+
+/*
+ * Fill the slot, then publish it by moving head
+ */
+bool TriggerQueue :: Push ( const TriggerEvent &event ) {
+	uint8_t h = head;
+	uint8_t next = (h + 1) & TRIGGER_QUEUE_MASK;
+	if ( next == tail ) return false;
+	ring[h] = event;
+	head = next;
+	return true;
+}
@@ -0,0 +1,80 @@
+/*
+ * TriggerQueue.h
+ *
+ * Lock-free single producer / single consumer ring of trigger events
+ * between the trigger ISR (producer) and loop() (consumer), with an
+ * explicit policy for edges that arrive while a tone is playing:
+ *
+ *	TRIGGER_DROP	- ignore the edge, count it in Dropped()
+ *	TRIGGER_QUEUE	- keep it; loop() plays it as soon as the current
+ *					  tone has ended (back-to-back)
+ *	TRIGGER_RESTART	- keep one; loop() cuts the current tone short and
+ *					  starts again. Further edges before that are counted
+ *					  in Coalesced()
+ *
+ * Edges while no tone plays but the path is not ready (e.g. between the
+ * offset and the re-arm) are always queued. A full ring counts the edge
+ * as dropped. Nothing is ever lost silently: every edge ends up played,
+ * dropped or coalesced, and Offer() says which.
+ *
+ * Head and tail are single bytes, so both sides only need atomic byte
+ * access; the producer only writes head, the consumer only tail.
+ */
+
+#ifndef TriggerQueue_h
+#define TriggerQueue_h
+
+#include "Hal.h"
+
+#define TRIGGER_QUEUE_SIZE		8		// events, power of 2 (one slot kept free)
+
+typedef enum {
+	TRIGGER_DROP,
+	TRIGGER_QUEUE,
+	TRIGGER_RESTART
+} TriggerPolicy;
+
+typedef enum {
+	TRIGGER_QUEUED,
+	TRIGGER_DROPPED,
+	TRIGGER_COALESCED
+} TriggerOutcome;
+
+struct TriggerEvent {
+	uint64_t	time;		// halTimerTicks64() time of the edge
+	uint8_t		lines;		// halTriggerPort() at the edge
+};
+
+class TriggerQueue {
+
+public:
+
+	TriggerQueue ( uint8_t policy = TRIGGER_DROP );
+
+	void SetPolicy ( uint8_t policy ) { this->policy = policy; }
+	uint8_t Policy ( void ) const { return policy; }
+
+	// Producer, from the trigger ISR. busy: a tone is playing
+	uint8_t Offer ( const TriggerEvent &event, bool busy );
+
+	// Consumer, from loop()
+	bool IsEmpty ( void ) const { return head == tail; }
+	bool Take ( TriggerEvent &event );
+
+	// Edges accepted, ignored (policy or full ring) and merged into a
+	// pending restart
+	uint16_t Queued ( void ) const { return queued; }
+	uint16_t Dropped ( void ) const { return dropped; }
+	uint16_t Coalesced ( void ) const { return coalesced; }
+
+private:
+
+	bool			Push ( const TriggerEvent &event );
+
+	TriggerEvent	ring[TRIGGER_QUEUE_SIZE];
+	volatile uint8_t	head, tail;
+	volatile uint16_t	queued, dropped, coalesced;
+	uint8_t			policy;
+};
+
+#endif
@@ -1,7 +1,18 @@
-#include <Arduino.h>
+#include "Hal.h"
 #include "AD9833.h"
-#include <Wire.h>
+#include "AD9833Words.h"
 #include "PT2258.h"
+#include "TriggerPlan.h"
+#include "ToneGate.h"
+#include "EventLog.h"
+#include "ToneSequence.h"
+#include "ToneRamp.h"
+#include "StimulusSelect.h"
+#include "TriggerQueue.h"
+#include "Scheduler.h"
+#include "CommandLink.h"
+#include "ProfileStore.h"
+#include "Probe.h"
 
 // =====================================================================
 // TDT-Controlled Pure Tone Generator
@@ -11,158 +22,1122 @@
 // - TDT controls full experiment timeline (CS, trace, US, ITI)
 // - Arduino acts as triggered tone generator only
 // - TTL pulse on Pin 3 → Play tone for fixed duration
+// - Armed mode: the onset is precompiled into raw register words and
+//   played directly from the INT1 vector (see TriggerPlan)
+// - All hardware access goes through lib/Hal, so this file also runs
+//   against the recording fakes of the "native" environment
 // =====================================================================
 
 // --------------------- Pin Definitions ----------------------
 #define FNC_PIN 2           // AD9833 SPI chip select
 #define TRIGGER_PIN 3       // TTL trigger input from TDT
 #define LED_PIN 8           // Status LED (indicates tone playing)
+#define SELECT_PIN 4        // First stimulus select line (port D, pins 4-7)
 
 // --------------------- Tone Parameters ----------------------
 #define TONE_FREQ 9500      // 9500 Hz pure tone (match eLife 2021)
 #define TONE_DURATION 350   // 350 ms tone duration
+#define TONE_RAMP_MS 0      // Raised-cosine rise/fall, 1-20 ms (0 = hard gate)
+#define TONE_TICKS (TONE_DURATION * 1000UL * GATE_TICKS_PER_US)  // Timer1 ticks
+#define RAMP_TICKS (TONE_RAMP_MS * 1000UL * GATE_TICKS_PER_US)
+
+// AD9833 words for the tone, computed by the compiler (no float math)
+typedef AD9833Words<TONE_FREQ, 0, SINE_WAVE> ToneWords;
 
 // Audio volume control (adjust to achieve 78-84 dB SPL)
 #define VOLUME_ATTENUATION 20  // PT2258 value (0=loudest, 79=muted)
+#if TONE_RAMP_MS
+#define REST_ATTENUATION RAMP_SILENT         // Ramps start and end silent
+#else
+#define REST_ATTENUATION VOLUME_ATTENUATION
+#endif
+
+// --------------------- Trigger Mode ----------------------
+#define TRIGGER_ARMED 1         // 1 = onset played from ISR, 0 = from loop()
+#define MUTE_BETWEEN_TRIALS 0   // 1 = PT2258 unmute also in ISR (+~50 us)
+#define STIMULUS_SEQUENCE 0     // 1 = play toneSweep instead of a fixed tone
+#ifndef STIMULUS_SELECT_BITS    // -D in the native_select test build
+#define STIMULUS_SELECT_BITS 0  // 2-4 = profile.table index on pins 4.. (0 = off)
+#endif
+#define RETRIGGER_POLICY TRIGGER_DROP  // Edge during a tone: TRIGGER_DROP,
+                                       // TRIGGER_QUEUE (back-to-back) or
+                                       // TRIGGER_RESTART (cut short, play again)
+
+// --------------------- Boot ----------------------
+#define FAST_BOOT 1             // 1 = skip the AD9833 power-up waits (115 ms)
+                                // after a warm reset; 0 = always wait. A
+                                // power-on or brown-out reset always waits
+
+#if TRIGGER_PIN != 3
+#error "TRIGGER_PIN must be pin 3 (INT1)"
+#endif
+
+#if TONE_RAMP_MS && (TONE_RAMP_MS > 20 || 2 * TONE_RAMP_MS > TONE_DURATION)
+#error "TONE_RAMP_MS must be 1-20 ms and fit twice into TONE_DURATION"
+#endif
+
+#if TONE_RAMP_MS && defined(HAL_I2C_WIRE)
+#error "TONE_RAMP_MS needs the HAL TWI engine (queued I2C from the ramp ISR)"
+#endif
+
+#if STIMULUS_SELECT_BITS && (STIMULUS_SELECT_BITS < 2 || STIMULUS_SELECT_BITS > 4)
+#error "STIMULUS_SELECT_BITS must be 2-4"
+#endif
+
+#if STIMULUS_SELECT_BITS && (!TRIGGER_ARMED || MUTE_BETWEEN_TRIALS || STIMULUS_SEQUENCE)
+#error "STIMULUS_SELECT_BITS needs TRIGGER_ARMED, without MUTE_BETWEEN_TRIALS or a sequence"
+#endif
+
+#if STIMULUS_SEQUENCE && !TRIGGER_ARMED
+#error "STIMULUS_SEQUENCE needs TRIGGER_ARMED"
+#endif
+
+// --------------------- Stimulus Sequence ----------------------
+// Played from FREQ0 by Timer1 compare B while the gate runs. Built at
+// compile time and kept in flash; the first segment must be a sine to
+// match the onset control word. Total length should match TONE_DURATION.
+const SeqSegment toneSweep[] HAL_FLASH = {
+    seqLog(4000, 16000, 200000, 250),   // 4 - 16 kHz chirp, 4 kHz update rate
+    seqTone(16000, 150000),             // then hold 16 kHz for 150 ms
+    SEQ_END
+};
+
+// --------------------- Rig Profile ----------------------
+// Everything a rig may change without reflashing. Loaded at boot from
+// EEPROM slot PROFILE_BOOT_SLOT (lib/ProfileStore) and saved there with
+// LINK_SAVE_PROFILE; the initialisers below are the defaults, kept when
+// the slot is empty or fails its check. Bump PROFILE_VERSION whenever
+// RigProfile changes.
+#define PROFILE_VERSION 1
+#define PROFILE_BOOT_SLOT 0
+
+// What the next trial plays. Serial commands only fill pendingTone; it
+// replaces profile.tone (or a stimulus table entry) between trials, so
+// an update can never reach a stimulus in flight
+struct ToneConfig {
+    uint32_t frequencyHz;
+    uint32_t freqWord;      // AD9833 tuning word of frequencyHz
+    uint16_t durationMs;    // Including ramps
+    uint8_t attenuation;
+    uint8_t index;          // Stimulus table entry (select lines)
+};
+
+// Calibration and gating, also swapped in between trials only
+struct RigOptions {
+    int8_t levelTrim;           // Speaker calibration: dB added to all levels
+    uint8_t muteBetweenTrials;  // 1 = PT2258 unmute also in ISR (no select)
+    uint8_t retriggerPolicy;    // TRIGGER_DROP, _QUEUE or _RESTART
+};
+
+struct RigProfile {
+    ToneConfig tone;            // Fixed tone (no select lines)
+    RigOptions options;
+#if STIMULUS_SELECT_BITS
+    // One entry per index on the select lines (bit 0 = pin 4), loaded
+    // into FREQ0 by loop() as soon as the lines change. Durations include
+    // ramps.
+    StimulusEntry table[1 << STIMULUS_SELECT_BITS];
+#endif
+};
+
+RigProfile profile = {
+    { TONE_FREQ, ToneWords::FREQ_WORD, TONE_DURATION, VOLUME_ATTENUATION, 0 },
+    { 0, MUTE_BETWEEN_TRIALS, RETRIGGER_POLICY },
+#if STIMULUS_SELECT_BITS
+    {
+        stimulusEntry(TONE_FREQ, VOLUME_ATTENUATION, TONE_DURATION),       // CS+
+        stimulusEntry(4000, VOLUME_ATTENUATION, TONE_DURATION),            // CS-
+        stimulusEntry(TONE_FREQ, VOLUME_ATTENUATION + 10, TONE_DURATION),  // CS+ -10 dB
+        stimulusEntry(4000, VOLUME_ATTENUATION + 10, TONE_DURATION),       // CS- -10 dB
+#if STIMULUS_SELECT_BITS > 2
+        // Indices 4 - 15: fill in for the paradigm (unset entries are silent)
+#endif
+    }
+#endif
+};
+
+static_assert(sizeof(RigProfile) <= PROFILE_MAX_BODY,
+              "RigProfile does not fit an EEPROM profile slot");
 
 // --------------------- Hardware Objects ----------------------
 PT2258 pt2258(0x8C);              // Digital volume controller (I2C)
-AD9833 waveGenerator(FNC_PIN);    // DDS waveform generator (SPI)
+AD9833Fast<FNC_PIN> waveGenerator;    // DDS waveform generator (SPI)
+TriggerPlan tonePlan(FNC_PIN, 0x8C);  // Precompiled onset/offset words
+ToneGate toneGate;                    // Timer1 offset scheduling
+EventLog eventLog;                    // Deferred serial event log
+#if STIMULUS_SEQUENCE
+ToneSequence toneSequence(FNC_PIN);   // Timer1 compare B frequency steps
+#endif
+#if TONE_RAMP_MS
+ToneRamp toneRamp(pt2258, 1);         // Timer2 paced attenuation ramps
+#endif
+#if STIMULUS_SELECT_BITS
+StimulusSelect stimulusSelect(FNC_PIN, SELECT_PIN, STIMULUS_SELECT_BITS,
+                              profile.table);  // TTL stimulus index
+#endif
+TriggerQueue triggerQueue(RETRIGGER_POLICY);  // Edges the ISR did not play
+ProfileStore profileStore;            // EEPROM rig profiles
+
+// --------------------- Tasks ----------------------
+#define LOG_DRAIN_MS 2      // 64 byte TX buffer lasts ~5.5 ms at 115200
+#define SERIAL_POLL_MS 5    // 64 byte RX buffer fills in ~5.5 ms
+#define LINK_TIMEOUT_POLLS 2  // Quiet polls before a partial frame is dropped
+
+PT_THREAD(stimulusThread(Task &task));
+PT_THREAD(logThread(Task &task));
+PT_THREAD(serialThread(Task &task));
+PT_THREAD(statsThread(Task &task));
+PT_THREAD(bannerThread(Task &task));
+#ifdef PROBES
+PT_THREAD(probeThread(Task &task));
+#endif
+
+Scheduler scheduler;                  // Protothreads on a 1 ms timer wheel
+Task stimulusTask(stimulusThread);    // Trigger queue, re-arm, select lines
+Task logTask(logThread);              // Event log to serial
+Task serialTask(serialThread);        // Serial commands
+Task statsTask(statsThread);          // Status report on request
+Task bannerTask(bannerThread);        // Boot banner, after setup()
+#ifdef PROBES
+Task probeTask(probeThread);          // Probe histograms on request
+#endif
+CommandLink commandLink;              // Binary serial commands
 
 // --------------------- State Variables ----------------------
-volatile bool triggerReceived = false;  // ISR flag
-bool toneActive = false;                // Tone playing state
-unsigned long toneStartTime = 0;        // Tone start timestamp
-unsigned long toneCount = 0;            // Diagnostic counter
+volatile bool toneActive = false;       // Onset to stop sequence (ISR and loop)
+volatile unsigned long toneCount = 0;   // Diagnostic counter
+#if !TRIGGER_ARMED
+bool toneStaged = false;                // Next tone staged in the idle pair
+#endif
+bool triggerEnabled = false;            // Trigger input on (LINK_ARM)
+
+// --------------------- Boot Report ----------------------
+// Timer1 ticks since toneGate.Begin() at the end of each setup() phase
+enum BootPhase {
+    BOOT_TIMER, BOOT_PINS, BOOT_AD9833, BOOT_PT2258, BOOT_PROFILE,
+    BOOT_PLAN, BOOT_TRIGGER, BOOT_TASKS, BOOT_PHASES
+};
+uint32_t bootTicks[BOOT_PHASES];
+uint32_t bootEntryUs;                   // micros() at setup() entry
+uint8_t profileResult;                  // ProfileStore::Load() at boot
+bool pt2258Found;
+
+// --------------------- Runtime Parameters ----------------------
+ToneConfig pendingTone;
+bool tonePending = false;
+RigOptions pendingOptions;
+bool optionsPending = false;
+uint32_t toneTicks = TONE_TICKS;        // Gate length, read by the ISR while armed
+
+// A level with the speaker calibration applied, within the PT2258 range
+static inline uint8_t trimmedLevel(uint8_t attenuation) {
+    int16_t level = attenuation + profile.options.levelTrim;
+    return level < 0 ? 0 : level > 79 ? 79 : level;
+}
+
+#if STIMULUS_SELECT_BITS
+// Full level of the selected stimulus: the ramp's target, or the PT2258
+// channel right away (queued, skipped when unchanged)
+static inline void selectLevel(uint8_t attenuation) {
+#if TONE_RAMP_MS
+    toneRamp.SetLevel(trimmedLevel(attenuation));
+#else
+    pt2258.attenuation(1, trimmedLevel(attenuation));
+#endif
+}
+#endif
+
+#if TRIGGER_ARMED
+// Armed onset with interrupts off, from the trigger ISR or for a queued
+// edge from loop(). Returns the Timer1 tick of the onset word
+static inline uint16_t startTone(uint8_t lines) {
+    toneActive = true;
+#if STIMULUS_SELECT_BITS
+    // Lines read at the edge; FREQ0 normally already holds that entry
+    const StimulusEntry &stimulus = stimulusSelect.Select(lines);
+    tonePlan.Fire();
+    uint16_t onset = halTimerNow();
+    PROBE_SINCE_TRIGGER(PROBE_ONSET);
+    selectLevel(stimulus.attenuation);
+    toneGate.Start(onset, stimulus.durationTicks - RAMP_TICKS);
+#else
+    (void)lines;
+#if STIMULUS_SEQUENCE
+    toneSequence.Start(toneSweep);   // FREQ0 = first step, still in RESET
+#endif
+    tonePlan.Fire();
+    uint16_t onset = halTimerNow();
+    PROBE_SINCE_TRIGGER(PROBE_ONSET);
+    toneGate.Start(onset, toneTicks - RAMP_TICKS);
+#endif
+#if TONE_RAMP_MS
+    toneRamp.Start(true);
+#endif
+    toneCount++;
+    return onset;
+}
+#endif
+
+// Trigger and onset of the tone just started
+static inline void logOnset(uint64_t edgeTime, uint64_t onsetTime) {
+    eventLog.Push(LOG_TRIGGER, toneCount, onsetTime - edgeTime, edgeTime);
+#if STIMULUS_SELECT_BITS
+    eventLog.Push(LOG_TONE_START, toneCount,
+                  profile.table[stimulusSelect.Selected()].frequencyHz,
+                  onsetTime);
+#else
+    eventLog.Push(LOG_TONE_START, toneCount, profile.tone.frequencyHz,
+                  onsetTime);
+#endif
+}
 
 // =====================================================================
 // INTERRUPT SERVICE ROUTINE
 // =====================================================================
-// Triggered by rising edge TTL pulse from TDT system
-void triggerISR() {
-    if (!toneActive) {  // Prevent re-triggering during playback
-        triggerReceived = true;
+// Triggered by rising edge TTL pulse from TDT system. INT1 is serviced
+// directly instead of through attachInterrupt() to skip the function
+// pointer dispatch. When armed, the onset words go out from here.
+// Events are stamped on the 64 bit Timer1 timebase; the trigger itself
+// at ISR entry, a fixed ~2 us after the edge.
+HAL_TRIGGER_ISR {
+    uint16_t edge = halTimerNow();
+    uint8_t lines = halTriggerPort();   // Select lines at the edge
+    PROBE_TRIGGER(edge);
+#if TRIGGER_ARMED
+    if (tonePlan.IsArmed() && triggerQueue.IsEmpty()) {
+        uint16_t onset = startTone(lines);
+        uint64_t edgeTime = halTimerExtend(edge);
+        logOnset(edgeTime, edgeTime + (uint16_t)(onset - edge));
+        PROBE_SINCE_TRIGGER(PROBE_ISR);
+        return;
+    }
+#endif
+    // Not ready, or earlier edges still waiting: loop() plays it (or the
+    // policy drops it). Either way it is counted and logged
+    TriggerEvent event = { halTimerExtend(edge), lines };
+    uint8_t outcome = triggerQueue.Offer(event, toneActive);
+    if (outcome == TRIGGER_DROPPED) {
+        eventLog.Push(LOG_TRIGGER_DROPPED, toneCount, triggerQueue.Dropped(),
+                      event.time);
+    } else if (outcome == TRIGGER_COALESCED) {
+        eventLog.Push(LOG_TRIGGER_COALESCED, toneCount,
+                      triggerQueue.Coalesced(), event.time);
+    }
+    PROBE_SINCE_TRIGGER(PROBE_ISR);
+}
+
+// Stop sequence, from the gate or the end of the fall ramp
+static inline void stopTone() {
+#if STIMULUS_SEQUENCE
+    toneSequence.Stop();
+#endif
+    tonePlan.Stop();            // AD9833 into RESET, mute if configured
+    uint64_t offsetTime = halTimerTicks64();
+    toneGate.Finish();
+    toneActive = false;
+#if STIMULUS_SEQUENCE
+    eventLog.Push(LOG_SEQUENCE, toneCount, toneSequence.MaxUpdateRateHz());
+#endif
+
+    // On-time from the onset word to the end of the stop sequence
+    eventLog.Push(LOG_TONE_END, toneCount,
+                  (toneGate.DurationTicks() + toneGate.LateTicks()) /
+                  GATE_TICKS_PER_US, offsetTime);
+}
+
+// Timer1 compare match: runs the stop sequence exactly toneTicks after
+// the onset (or starts the fall ramp that ends there), independent of
+// what loop() is doing.
+HAL_TIMER_COMPARE_ISR {
+    if (toneGate.Expired()) {
+#if TONE_RAMP_MS
+        toneRamp.Start(false);      // Stop sequence follows the last step
+#else
+        stopTone();
+#endif
+    }
+}
+
+#if TONE_RAMP_MS
+// Timer2 tick: next ramp step, then the stop sequence after the fall
+HAL_TICKER_ISR {
+    if (toneRamp.Step()) {
+        eventLog.Push(toneRamp.IsUp() ? LOG_RAMP_UP : LOG_RAMP_DOWN, toneCount,
+                      (uint32_t)toneRamp.Updates() << 24 |
+                      toneRamp.MeasuredMicros());
+        if (!toneRamp.IsUp()) stopTone();
+    }
+}
+#endif
+
+#if STIMULUS_SEQUENCE
+// Timer1 compare B: next frequency step of the running sequence
+HAL_TIMER_COMPARE_B_ISR {
+    toneSequence.Step();
+}
+#endif
+
+// =====================================================================
+// PARAMETER UPDATES - Between Trials Only
+// =====================================================================
+// Onset/offset plan, level and gate length for profile.tone, with the
+// profile's calibration and gating. The offset table is also used by the
+// Timer1 stop sequence in loop() mode, where it has to mute. Disarmed
+// callers only: the ISR reads all of these.
+static void compileTone() {
+    StimulusWords spec;
+    spec.control = ToneWords::CONTROL;
+    spec.freqLsb = ad9833FreqLsb(profile.tone.freqWord);
+    spec.freqMsb = ad9833FreqMsb(profile.tone.freqWord);
+    spec.phase = ToneWords::PHASE0;
+    spec.channel = 1;
+    spec.attenuation = REST_ATTENUATION;
+#if TONE_RAMP_MS
+    toneRamp.SetLevel(trimmedLevel(profile.tone.attenuation));
+#else
+    spec.attenuation = trimmedLevel(profile.tone.attenuation);
+#if !TRIGGER_ARMED
+    pt2258.attenuation(1, spec.attenuation);  // No arm table here
+#endif
+#endif
+    // The select path sets levels while armed, so it never mutes
+    spec.muteBetweenTrials = (profile.options.muteBetweenTrials &&
+                              !STIMULUS_SELECT_BITS) || !TRIGGER_ARMED;
+    tonePlan.Compile(spec);
+    toneTicks = profile.tone.durationMs * 1000UL * GATE_TICKS_PER_US;
+}
+
+#if TRIGGER_ARMED
+// Arm the onset plan. A first Arm() after compileTone() writes the PT2258
+// levels directly, so the driver forgets what it thinks the chip holds:
+// a selectLevel() equal to its stale level would be skipped otherwise
+static void armTone() {
+    if (tonePlan.Arm()) pt2258.invalidate();
+}
+#endif
+
+// Swap in pending updates. Called disarmed, before the next onset is
+// prepared
+static void applyPendingTone() {
+    if (optionsPending) {
+        profile.options = pendingOptions;
+        triggerQueue.SetPolicy(profile.options.retriggerPolicy);
+        optionsPending = false;
+#if !STIMULUS_SELECT_BITS
+        if (!tonePending) compileTone();
+#endif
     }
+    if (!tonePending) return;
+#if STIMULUS_SELECT_BITS
+    StimulusEntry &entry = profile.table[pendingTone.index];
+    entry.freqLsb = ad9833FreqLsb(pendingTone.freqWord);
+    entry.freqMsb = ad9833FreqMsb(pendingTone.freqWord);
+    entry.durationTicks = pendingTone.durationMs * 1000UL * GATE_TICKS_PER_US;
+    entry.frequencyHz = pendingTone.frequencyHz;
+    entry.attenuation = pendingTone.attenuation;
+#else
+    profile.tone = pendingTone;
+    compileTone();
+#endif
+    tonePending = false;
+}
+
+// Boot: the saved profile replaces the defaults if it checks out. Before
+// compileTone(), so it goes straight into the register plan
+static void loadProfile() {
+    profileResult = profileStore.Load(PROFILE_BOOT_SLOT, &profile,
+                                      sizeof(profile), PROFILE_VERSION);
+    triggerQueue.SetPolicy(profile.options.retriggerPolicy);
+}
+
+static inline void bootMark(uint8_t phase) {
+    bootTicks[phase] = (uint32_t)halTimerTicks64();
 }
 
 // =====================================================================
 // SETUP - Initialize Hardware
 // =====================================================================
+// Shortest path to a silent, armed unit: outputs muted first, then the
+// plan, then the trigger input. Nothing is printed here; bannerTask
+// reports all of it, including the time of each phase, once loop() runs.
 void setup() {
-    Serial.begin(115200);
-
-    // Print system header
-    Serial.println("\n\n");
-    Serial.println("==============================================");
-    Serial.println("===   TDT-CONTROLLED TONE GENERATOR       ===");
-    Serial.println("===   Pure Tone: 9500 Hz, 350 ms          ===");
-    Serial.println("==============================================");
-    Serial.println("Mode: External trigger (Pin 3)");
+    bootEntryUs = halMicros();
+    toneGate.Begin();           // Timer1: gate and 64 bit event timebase
+    bootMark(BOOT_TIMER);
 
     // Initialize GPIO pins
-    pinMode(LED_PIN, OUTPUT);
-    pinMode(FNC_PIN, OUTPUT);
-    pinMode(TRIGGER_PIN, INPUT); 
-    digitalWrite(LED_PIN, LOW);
+    halPinMode(LED_PIN, OUTPUT);
+    halPinMode(FNC_PIN, OUTPUT);
+    halPinMode(TRIGGER_PIN, INPUT); 
+#if STIMULUS_SELECT_BITS
+    stimulusSelect.Begin();
+#endif
+    halDigitalWrite(LED_PIN, LOW);
+    bootMark(BOOT_PINS);
 
-    // Setup external trigger interrupt (rising edge)
-    attachInterrupt(digitalPinToInterrupt(TRIGGER_PIN), triggerISR, RISING);
-    Serial.println("[INIT] Trigger interrupt configured on Pin 3");
-
-    // Initialize AD9833 DDS waveform generator
-    waveGenerator.Begin();
+    // Initialize AD9833 DDS waveform generator: in RESET, so silent. From
+    // power-on both chips get the settle time before their first write
+    waveGenerator.Begin(!FAST_BOOT || halPowerOnReset());
     waveGenerator.EnableOutput(false);
-    Serial.println("[INIT] AD9833 waveform generator initialized");
+    bootMark(BOOT_AD9833);
 
     // Initialize PT2258 digital volume controller
-    Wire.setClock(400000);  // I2C at 400 kHz
+    halI2cBegin();
+    halI2cSetClock(400000);  // I2C at 400 kHz
+    pt2258Found = pt2258.begin();
 
-    if (pt2258.begin()) {
-        Serial.println("[INIT] PT2258 volume controller initialized");
-    } else {
-        Serial.println("[ERROR] PT2258 initialization FAILED!");
-        Serial.println("       Check I2C wiring (SDA=A4, SCL=A5)");
-    }
+    // Gating mode: the level is set once here, trials only toggle mute
+    pt2258.mute(true);          // Mute all channels first (true = muted)
+    pt2258.attenuation(1, REST_ATTENUATION);
+    pt2258.setAsync(true);      // From here on, mute() returns at once
+    bootMark(BOOT_PT2258);
+
+    Serial.begin(115200);
+    loadProfile();
+    bootMark(BOOT_PROFILE);
+
+    // Compile the onset/offset plan for the saved or default profile
+#if TONE_RAMP_MS
+    toneRamp.Begin(TONE_RAMP_MS * 1000U, VOLUME_ATTENUATION);
+#endif
+    compileTone();
+#if !TONE_RAMP_MS
+    // The gate matches early by the stop words, so the RESET word ends
+    // exactly toneTicks after the onset word (the fall ramp sets its own)
+    toneGate.SetLead(tonePlan.OffsetLeadCycles() /
+                     (HAL_CYCLES_PER_US / GATE_TICKS_PER_US));
+#endif
+
+#if TRIGGER_ARMED
+    // FREQ0 words startTone() may write ahead of the onset, for the bound
+#if STIMULUS_SELECT_BITS
+    tonePlan.SetPreFireWords(SELECT_MISS_WORDS);
+#elif STIMULUS_SEQUENCE
+    tonePlan.SetPreFireWords(SEQ_START_WORDS);
+#endif
+    armTone();
+#if STIMULUS_SELECT_BITS
+    stimulusSelect.Forget();    // Arm() loaded the TONE_FREQ words
+#endif
+#else
+    // Stage the tone in the idle FREQ/PHASE pair, so the onset in loop()
+    // is one control word that selects it and releases RESET
+    waveGenerator.StageWords(SINE_WAVE, profile.tone.freqWord,
+                             ToneWords::PHASE_VALUE);
+    toneStaged = true;
+#endif
+    bootMark(BOOT_PLAN);
 
-    pt2258.attenuation(1, 79);  // Set max attenuation first
-    pt2258.mute(true);          // Then mute all channels (true = muted)
+    // Setup external trigger interrupt (INT1, rising edge)
+    halTriggerEnable();         // Discards any edge seen during setup
+    triggerEnabled = true;
+    bootMark(BOOT_TRIGGER);
 
-    // Display configuration
-    Serial.println("\n--- TONE PARAMETERS ---");
-    Serial.print("Frequency:        ");
-    Serial.print(TONE_FREQ);
-    Serial.println(" Hz");
+    // Tasks in priority order: the tone path runs first on every pass
+    scheduler.Begin();
+    scheduler.Add(stimulusTask);
+    scheduler.Add(logTask);
+    scheduler.Add(serialTask);
+    scheduler.Add(statsTask);
+    scheduler.Add(bannerTask);  // READY: the banner goes out right away
+#ifdef PROBES
+    scheduler.Add(probeTask);
+#endif
+    bootMark(BOOT_TASKS);
+}
 
-    Serial.print("Duration:         ");
-    Serial.print(TONE_DURATION);
-    Serial.println(" ms");
+// =====================================================================
+// RETRIGGER HANDLING
+// =====================================================================
+// Ready for the next onset: armed again, or the next tone staged
+static inline bool readyForTone() {
+#if TRIGGER_ARMED
+    return tonePlan.IsArmed();
+#else
+    return toneStaged;
+#endif
+}
 
-    Serial.print("Volume (atten):   ");
-    Serial.print(VOLUME_ATTENUATION);
-    Serial.println(" dB");
+// Prepare the next onset after a stop sequence
+static void rearm() {
+    applyPendingTone();
+#if TRIGGER_ARMED
+    armTone();                  // Ready for the next trigger
+#if STIMULUS_SELECT_BITS
+    stimulusSelect.Forget();
+#endif
+#else
+    // The stop words bypassed the drivers: resync the AD9833 control
+    // word and the PT2258 mute, then stage the next tone in the pair
+    // that just went idle
+    pt2258.invalidate();
+    waveGenerator.Invalidate(SHADOW_CONTROL);
+    waveGenerator.EnableOutput(false);
+    waveGenerator.StageWords(SINE_WAVE, profile.tone.freqWord,
+                             ToneWords::PHASE_VALUE);
+    toneStaged = true;
+#endif
+}
 
-    Serial.println("\n--- HARDWARE CONNECTIONS ---");
-    Serial.println("Pin 3:  TTL trigger input (from TDT)");
-    Serial.println("Pin 8:  Status LED (ON during tone)");
-    Serial.println("Audio:  Connect to amplifier/speaker");
+// TRIGGER_RESTART: cut the playing tone short (no END record) so the
+// pending edge can start it again
+static void abortTone() {
+    HalIrqState state = halIrqSave();
+    bool playing = toneActive;
+    if (playing) {
+        toneGate.Cancel();
+#if TONE_RAMP_MS
+        toneRamp.Cancel();
+#endif
+#if STIMULUS_SEQUENCE
+        toneSequence.Stop();
+#endif
+    }
+    halIrqRestore(state);
+    if (!playing) return;       // Stopped by itself meanwhile
 
-    Serial.println("\n==============================================");
-    Serial.println("[READY] Waiting for TDT triggers...");
-    Serial.println("==============================================\n");
+    halI2cFlush();              // Ramp writes out before raw stop words
+    state = halIrqSave();
+    tonePlan.Stop();
+    toneActive = false;
+    halIrqRestore(state);
+#if TONE_RAMP_MS
+    // The ramp left the channel at full or a mid-ramp level: the arm table
+    // sends REST_ATTENUATION again, so the next onset starts silent
+    tonePlan.Invalidate();
+#endif
+    eventLog.Push(LOG_TONE_RESTART, toneCount, 0);
+    rearm();
 }
 
 // =====================================================================
-// MAIN LOOP - Handle Trigger and Tone Timing
+// STIMULUS TASK - Handle Trigger and Tone Timing
 // =====================================================================
-void loop() {
+// Everything loop() does for the tone path; runs on every scheduler pass
+static void serviceStimulus() {
+    // ========== TONE STOPPED BY TIMER1 ==========
+    if (toneGate.TakeStopped()) {
+        rearm();
+        halDigitalWrite(LED_PIN, LOW);
+    }
+
+    // ========== PARAMETER UPDATE WHILE IDLE ==========
+    // Take the path out of the ISR's hands first; an edge meanwhile is
+    // queued and plays with the new parameters
+    if (tonePending || optionsPending) {
+        HalIrqState state = halIrqSave();
+        bool idle = !toneActive;
+        if (idle) tonePlan.Disarm();
+        halIrqRestore(state);
+        if (idle) rearm();
+    }
+
+    // ========== RETRIGGER: CUT THE TONE SHORT ==========
+    if (triggerQueue.Policy() == TRIGGER_RESTART && !triggerQueue.IsEmpty()) {
+        abortTone();
+    }
+
+#if TRIGGER_ARMED
+    // ========== ONSET PLAYED BY ISR ==========
+    if (tonePlan.TakeFired()) {
+        PROBE_SINCE_TRIGGER(PROBE_PICKUP);
+        halDigitalWrite(LED_PIN, HIGH);  // Visual indicator
+    }
+
+    // ========== QUEUED TRIGGER: ONSET FROM HERE ==========
+    // Same onset as the ISR; interrupts stay off so a new edge queues
+    // behind this one instead of overtaking it
+    if (tonePlan.IsArmed() && !triggerQueue.IsEmpty()) {
+        TriggerEvent next;
+        HalIrqState state = halIrqSave();
+        if (triggerQueue.Take(next)) {
+            PROBE_SINCE_TRIGGER(PROBE_PICKUP);
+            uint64_t onsetTime = halTimerExtend(startTone(next.lines));
+            logOnset(next.time, onsetTime);
+        }
+        halIrqRestore(state);
+    }
+#else
     // ========== CHECK FOR NEW TRIGGER ==========
-    if (triggerReceived) {
-        triggerReceived = false;
+    TriggerEvent next;
+    if (toneStaged && triggerQueue.Take(next)) {
+        PROBE_SINCE_TRIGGER(PROBE_PICKUP);
+        toneStaged = false;
+        toneActive = true;
+
+        // Configure and enable audio output
+        pt2258.mute(false);                 // Unmute audio (queued)
+        waveGenerator.SwitchToStaged(true);         // One control word
+        uint64_t onsetTime = halTimerTicks64();
+        PROBE_SINCE_TRIGGER(PROBE_ONSET);
+        toneGate.Start((uint16_t)onsetTime, toneTicks - RAMP_TICKS);
+#if TONE_RAMP_MS
+        toneRamp.Start(true);
+#endif
+
         toneCount++;
+        logOnset(next.time, onsetTime);
+        halDigitalWrite(LED_PIN, HIGH);  // Visual indicator
+    }
+#endif
+
+#if STIMULUS_SELECT_BITS
+    // ========== LOAD THE SELECTED STIMULUS ==========
+    // While armed, FREQ0 follows the select lines, so an index set before
+    // the edge costs nothing at the onset
+    HalIrqState state = halIrqSave();
+    bool loaded = tonePlan.IsArmed() && stimulusSelect.Prepare();
+    halIrqRestore(state);
+    if (loaded) {
+        selectLevel(profile.table[stimulusSelect.Staged()].attenuation);
+        halI2cFlush();              // Queue empty again while armed
+    }
+#endif
+}
+
+PT_THREAD(stimulusThread(Task &task)) {
+    PT_BEGIN(&task.pt);
+    for (;;) {
+        serviceStimulus();
+        PT_YIELD(&task.pt);         // Stays READY: every pass
+    }
+    PT_END(&task.pt);
+}
 
-        // Start tone playback
-        Serial.print("[");
-        Serial.print(millis());
-        Serial.print(" ms] Tone #");
-        Serial.print(toneCount);
-        Serial.print(" START (");
-        Serial.print(TONE_FREQ);
-        Serial.println(" Hz)");
+// =====================================================================
+// BACKGROUND TASKS - Logging, Serial Commands, Statistics
+// =====================================================================
+// Send logged events: only what fits in the TX buffer, so this never
+// blocks, and never while a queued trigger waits for its onset
+PT_THREAD(logThread(Task &task)) {
+    PT_BEGIN(&task.pt);
+    for (;;) {
+        PT_WAIT_UNTIL(&task.pt, triggerQueue.IsEmpty() || !readyForTone());
+        eventLog.Drain(Serial);
+        TASK_SLEEP(task, LOG_DRAIN_MS);
+    }
+    PT_END(&task.pt);
+}
 
-        digitalWrite(LED_PIN, HIGH);  // Visual indicator
+// Tones the link can address: the select table, or profile.tone
+#if STIMULUS_SELECT_BITS
+static const uint8_t TONE_ENTRIES = 1 << STIMULUS_SELECT_BITS;
+#else
+static const uint8_t TONE_ENTRIES = 1;
+#endif
 
-        // Configure and enable audio output
-        pt2258.attenuation(1, VOLUME_ATTENUATION);  // Set volume
-        pt2258.mute(false);                         // Unmute audio
-        waveGenerator.ApplySignal(SINE_WAVE, REG0, TONE_FREQ);
-        waveGenerator.EnableOutput(true);
+// LINK_SET_TONE: check and stage an update for the next trial
+static uint8_t setTone(const LinkFrame &frame) {
+    if (frame.length != 8) return LINK_BAD_LENGTH;
+    if (tonePending) return LINK_BUSY;
 
-        toneStartTime = millis();
-        toneActive = true;
+    ToneConfig tone;
+    tone.index = frame.payload[0];
+    tone.frequencyHz = CommandLink::Get32(frame.payload + 1);
+    tone.durationMs = CommandLink::Get16(frame.payload + 5);
+    tone.attenuation = frame.payload[7];
+#if STIMULUS_SELECT_BITS
+    const uint32_t maxHz = 0xFFFF;              // StimulusEntry field
+#else
+    const uint32_t maxHz = AD9833_MAX_MCLK / 2;
+#endif
+    if (tone.index >= TONE_ENTRIES || tone.frequencyHz < 1 ||
+        tone.frequencyHz > maxHz || tone.durationMs <= 2 * TONE_RAMP_MS ||
+        tone.durationMs > 60000U || tone.attenuation > 79) {
+        return LINK_BAD_VALUE;
+    }
+    tone.freqWord = ad9833FreqWord(tone.frequencyHz);
+    pendingTone = tone;
+    tonePending = true;
+    return LINK_OK;
+}
+
+// LINK_GET_TONE data: what trials play now, for an index below
+// TONE_ENTRIES
+static uint8_t *getTone(uint8_t *p, uint8_t index) {
+    *p++ = index;
+#if STIMULUS_SELECT_BITS
+    const StimulusEntry &entry = stimulusSelect.Entry(index);
+    p = CommandLink::Put32(p, entry.frequencyHz);
+    p = CommandLink::Put16(p, entry.durationTicks /
+                              (1000UL * GATE_TICKS_PER_US));
+    *p++ = entry.attenuation;
+#else
+    p = CommandLink::Put32(p, profile.tone.frequencyHz);
+    p = CommandLink::Put16(p, profile.tone.durationMs);
+    *p++ = profile.tone.attenuation;
+#endif
+    *p++ = tonePending;
+    return p;
+}
+
+// LINK_SET_OPTIONS: check and stage calibration and gating for the next
+// trial
+static uint8_t setOptions(const LinkFrame &frame) {
+    if (frame.length != 3) return LINK_BAD_LENGTH;
+    if (optionsPending) return LINK_BUSY;
+
+    RigOptions options;
+    options.levelTrim = (int8_t)frame.payload[0];
+    options.muteBetweenTrials = frame.payload[1];
+    options.retriggerPolicy = frame.payload[2];
+    if (options.levelTrim < -79 || options.levelTrim > 79 ||
+        options.muteBetweenTrials > (STIMULUS_SELECT_BITS ? 0 : 1) ||
+        options.retriggerPolicy > TRIGGER_RESTART) {
+        return LINK_BAD_VALUE;
+    }
+    pendingOptions = options;
+    optionsPending = true;
+    return LINK_OK;
+}
+
+// Execute one command frame and build its reply. Returns the reply length
+static uint8_t handleCommand(const LinkFrame &frame, uint8_t *reply) {
+    uint8_t data[LINK_MAX_PAYLOAD];
+    uint8_t *p = data;
+    uint8_t status = LINK_OK;
+    HalIrqState state;
+
+    switch (frame.command) {
+    case LINK_PING:
+        *p++ = LINK_VERSION;
+        break;
+    case LINK_SET_TONE:
+        status = setTone(frame);
+        break;
+    case LINK_GET_TONE:
+        if (frame.length != 1) status = LINK_BAD_LENGTH;
+        else if (frame.payload[0] >= TONE_ENTRIES) status = LINK_BAD_VALUE;
+        else p = getTone(p, frame.payload[0]);
+        break;
+    case LINK_SET_OPTIONS:
+        status = setOptions(frame);
+        break;
+    case LINK_GET_OPTIONS:
+        *p++ = profile.options.levelTrim;
+        *p++ = profile.options.muteBetweenTrials;
+        *p++ = profile.options.retriggerPolicy;
+        *p++ = optionsPending;
+        break;
+    case LINK_SAVE_PROFILE:
+        // Applied updates only; the reply waits for the last write
+        if (frame.length != 1) status = LINK_BAD_LENGTH;
+        else if (tonePending || optionsPending) status = LINK_BUSY;
+        else if (profileStore.BeginSave(frame.payload[0], &profile,
+                                        sizeof(profile), PROFILE_VERSION)) {
+            status = LINK_BAD_VALUE;
+        }
+        break;
+    case LINK_ARM:
+        if (!triggerEnabled) halTriggerEnable();   // Drops edges seen while off
+        triggerEnabled = true;
+        break;
+    case LINK_DISARM:
+        halTriggerDisable();    // A tone in flight still plays to its end
+        triggerEnabled = false;
+        break;
+    case LINK_GET_COUNTERS:
+        state = halIrqSave();   // Consistent snapshot of the ISR counters
+        p = CommandLink::Put32(p, toneCount);
+        p = CommandLink::Put16(p, triggerQueue.Dropped());
+        p = CommandLink::Put16(p, triggerQueue.Coalesced());
+        p = CommandLink::Put16(p, eventLog.Overruns());
+#if STIMULUS_SELECT_BITS
+        p = CommandLink::Put16(p, stimulusSelect.Misses());
+#else
+        p = CommandLink::Put16(p, 0);
+#endif
+        halIrqRestore(state);
+        p = CommandLink::Put16(p, commandLink.Errors());
+        break;
+    case LINK_GET_STATUS:
+        *p++ = (triggerEnabled ? LINK_FLAG_ENABLED : 0) |
+               (readyForTone() ? LINK_FLAG_ARMED : 0) |
+               (toneActive ? LINK_FLAG_PLAYING : 0) |
+               (tonePending || optionsPending ? LINK_FLAG_PENDING : 0);
+        p = CommandLink::Put16(p, scheduler.OverheadTicks());
+        p = CommandLink::Put16(p, scheduler.MaxOverheadTicks());
+        p = CommandLink::Put32(p, scheduler.Passes());
+        break;
+    default:
+        status = LINK_BAD_COMMAND;
+        break;
+    }
+    if (status != LINK_OK) p = data;
+    return CommandLink::Reply(reply, frame.command, status, data, p - data);
+}
+
+// Serial input: binary command frames (lib/CommandLink) and, between
+// frames, '?' for the status report, 'i' for the boot banner and, with
+// PROBES, 'p' for the probe histograms. Reads only what has arrived;
+// a profile save runs one EEPROM cell per pass before its reply goes out
+PT_THREAD(serialThread(Task &task)) {
+    static uint8_t reply[LINK_MAX_FRAME];
+    static uint8_t replyLength;
+    static uint8_t quietPolls;
+    int b;
+
+    PT_BEGIN(&task.pt);
+    for (;;) {
+        if (Serial.available() > 0) {
+            quietPolls = 0;
+        } else if (commandLink.InFrame() && ++quietPolls >= LINK_TIMEOUT_POLLS) {
+            commandLink.Abort();    // Sender went quiet mid-frame
+        }
+
+        while (Serial.available() > 0) {
+            b = Serial.read();
+            if (!commandLink.InFrame() && b == '?') {
+                scheduler.Wake(statsTask);
+            } else if (!commandLink.InFrame() && b == 'i') {
+                scheduler.Wake(bannerTask);
+#ifdef PROBES
+            } else if (!commandLink.InFrame() && b == 'p') {
+                scheduler.Wake(probeTask);
+#endif
+            } else if (commandLink.Feed(b)) {
+                replyLength = handleCommand(commandLink.Received(), reply);
+                PT_WAIT_UNTIL(&task.pt, profileStore.SaveStep());
+                PT_WAIT_UNTIL(&task.pt,
+                              Serial.availableForWrite() >= replyLength);
+                Serial.write(reply, replyLength);
+            }
+        }
+        TASK_SLEEP(task, SERIAL_POLL_MS);
+    }
+    PT_END(&task.pt);
+}
+
+// Room for a line printed in parts, between two whole log lines, so a
+// report never splits an event line (or the other way round)
+#define STATUS_ROOM(task, bytes)                                  \
+    PT_WAIT_UNTIL(&(task).pt, eventLog.IsIdle() &&                \
+                  Serial.availableForWrite() >= (bytes))
+
+// One status line, once the TX buffer can take it whole
+#define STATUS_LINE(task, label, value, unit)                     \
+    do {                                                          \
+        STATUS_ROOM(task, 40);                                    \
+        Serial.print(label);                                      \
+        Serial.print(value);                                      \
+        Serial.println(unit);                                     \
+    } while (0)
+
+// Text line, the same way (61 characters max)
+#define STATUS_TEXT(task, text)                                   \
+    do {                                                          \
+        STATUS_ROOM(task, (int)sizeof(text) + 1);                 \
+        Serial.println(text);                                     \
+    } while (0)
+
+// Status report between tones, written without blocking the loop
+PT_THREAD(statsThread(Task &task)) {
+    PT_BEGIN(&task.pt);
+    for (;;) {
+        TASK_SUSPEND(task);         // Until a '?' arrives
+        PT_WAIT_UNTIL(&task.pt, !toneActive && eventLog.IsIdle());
+
+        STATUS_LINE(task, "\n--- STATUS ---\nTones:            ",
+                    toneCount, "");
+        STATUS_LINE(task, "Triggers dropped: ",
+                    (unsigned int)triggerQueue.Dropped(), "");
+        STATUS_LINE(task, "Triggers merged:  ",
+                    (unsigned int)triggerQueue.Coalesced(), "");
+        STATUS_LINE(task, "Log overruns:     ",
+                    (unsigned int)eventLog.Overruns(), "");
+        STATUS_LINE(task, "Link errors:      ",
+                    (unsigned int)commandLink.Errors(), "");
+#if STIMULUS_SELECT_BITS
+        STATUS_LINE(task, "Select misses:    ",
+                    (unsigned int)stimulusSelect.Misses(), "");
+#endif
+        STATUS_LINE(task, "Loop passes:      ", scheduler.Passes(), "");
+        STATUS_LINE(task, "Loop overhead:    ",
+                    (unsigned int)(scheduler.OverheadTicks() /
+                                   HAL_TIMER_TICKS_PER_US), " us avg");
+        STATUS_LINE(task, "                  ",
+                    (unsigned int)(scheduler.MaxOverheadTicks() /
+                                   HAL_TIMER_TICKS_PER_US), " us max");
+        STATUS_LINE(task, "Stimulus task:    ",
+                    (unsigned int)(stimulusTask.MaxRunTicks() /
+                                   HAL_TIMER_TICKS_PER_US), " us max");
+        STATUS_LINE(task, "Log task:         ",
+                    (unsigned int)(logTask.MaxRunTicks() /
+                                   HAL_TIMER_TICKS_PER_US), " us max");
+    }
+    PT_END(&task.pt);
+}
+
+#ifdef PROBES
+// Probe histograms (lib/Probe) on 'p', cleared as they are read, so each
+// dump covers the trials since the last one. Timer1 ticks (0.5 us); a
+// bucket line counts the samples from its floor to the next bucket's
+PT_THREAD(probeThread(Task &task)) {
+    static ProbeHistogram h;    // Snapshot: the ISRs keep recording
+    static uint8_t id, b;
+
+    PT_BEGIN(&task.pt);
+    for (;;) {
+        TASK_SUSPEND(task);         // Until a 'p' arrives
+        PT_WAIT_UNTIL(&task.pt, !toneActive && eventLog.IsIdle());
+
+        STATUS_TEXT(task, "\n--- PROBES (Timer1 ticks, 0.5 us) ---");
+        for (id = 0; id < PROBE_COUNT; id++) {
+            {
+                HalIrqState state = halIrqSave();
+                h = probes[id];
+                probes[id].Clear();
+                halIrqRestore(state);
+            }
+            STATUS_ROOM(task, 50);
+            Serial.print(probeNames[id]);
+            Serial.print(": n=");
+            Serial.print(h.count);
+            Serial.print(" min=");
+            Serial.print(h.min);
+            Serial.print(" max=");
+            Serial.println(h.max);
+            for (b = 0; b < PROBE_BUCKETS; b++) {
+                if (!h.buckets[b]) continue;
+                STATUS_ROOM(task, 30);
+                Serial.print("  >=");
+                Serial.print(ProbeHistogram::BucketFloor(b));
+                Serial.print(": ");
+                Serial.println(h.buckets[b]);
+            }
+        }
     }
+    PT_END(&task.pt);
+}
+#endif
+
+static const char *const profileResults[] = {
+    "loaded", "empty", "other version", "wrong size", "bad CRC", "no slot"
+};
+
+static const char *const bootPhaseNames[BOOT_PHASES] = {
+    "Timer1:           ", "Pins:             ", "AD9833 (silent):  ",
+    "PT2258 (muted):   ", "Profile:          ", "Onset plan:       ",
+    "Trigger on:       ", "Tasks:            "
+};
+
+// Banner, configuration and boot timing: once after setup(), again on
+// 'i'. Between tones and without blocking the loop, like the status
+// report, so it costs the boot nothing
+PT_THREAD(bannerThread(Task &task)) {
+    static uint8_t phase;
+
+    PT_BEGIN(&task.pt);
+    for (;;) {
+        PT_WAIT_UNTIL(&task.pt, !toneActive && eventLog.IsIdle());
+
+        STATUS_TEXT(task, "\n\n");
+        STATUS_TEXT(task, "==============================================");
+        STATUS_TEXT(task, "===   TDT-CONTROLLED TONE GENERATOR       ===");
+        STATUS_ROOM(task, 50);
+        {
+            // The tone trials play now, boxed like the lines around it
+            uint8_t width = Serial.print("===   Pure Tone: ");
+            width += Serial.print(profile.tone.frequencyHz);
+            width += Serial.print(" Hz, ");
+            width += Serial.print((unsigned int)profile.tone.durationMs);
+            width += Serial.print(" ms");
+            while (width++ < 42) Serial.print(' ');
+            Serial.println("===");
+        }
+        STATUS_TEXT(task, "==============================================");
+        STATUS_TEXT(task, "Mode: External trigger (Pin 3)");
+        STATUS_TEXT(task, "[INIT] AD9833 waveform generator initialized");
+        if (pt2258Found) {
+            STATUS_TEXT(task, "[INIT] PT2258 volume controller initialized");
+        } else {
+            STATUS_TEXT(task, "[ERROR] PT2258 initialization FAILED!");
+            STATUS_TEXT(task, "       Check I2C wiring (SDA=A4, SCL=A5)");
+        }
 
-    // ========== CHECK TONE DURATION ==========
-    if (toneActive) {
-        unsigned long elapsed = millis() - toneStartTime;
+        STATUS_ROOM(task, 60);
+        Serial.print("[INIT] Profile ");
+        Serial.print(PROFILE_BOOT_SLOT);
+        Serial.print(": ");
+        Serial.print(profileResults[profileResult]);
+        if (profileResult != PROFILE_OK) Serial.print(", using defaults");
+        Serial.print(" (");
+        Serial.print((unsigned int)(profileStore.LoadTicks() /
+                                    HAL_TIMER_TICKS_PER_US));
+        Serial.print(" us, CRC ");
+        Serial.print((unsigned int)(profileStore.CrcTicks() /
+                                    HAL_TIMER_TICKS_PER_US));
+        Serial.println(" us)");
 
-        if (elapsed >= TONE_DURATION) {
-            // Stop tone playback
-            waveGenerator.EnableOutput(false);
-            pt2258.mute(true);          // Mute audio
-            pt2258.attenuation(1, 79);  // Set max attenuation
-            digitalWrite(LED_PIN, LOW);
+#if TRIGGER_ARMED
+        STATUS_ROOM(task, 60);
+        Serial.print("[INIT] Trigger armed: ");
+        Serial.print(tonePlan.OnsetTable().count);
+        Serial.print(" onset step(s), worst case ");
+        Serial.print(tonePlan.OnsetBoundCycles() / HAL_CYCLES_PER_US);
+        Serial.println(" us");
+#endif
+        STATUS_TEXT(task, "[INIT] Trigger interrupt configured on Pin 3");
 
-            Serial.print("[");
-            Serial.print(millis());
-            Serial.print(" ms] Tone #");
-            Serial.print(toneCount);
-            Serial.print(" END (duration: ");
-            Serial.print(elapsed);
-            Serial.println(" ms)\n");
+        // Display configuration
+        STATUS_TEXT(task, "\n--- TONE PARAMETERS ---");
+        STATUS_LINE(task, "Frequency:        ", profile.tone.frequencyHz, " Hz");
+        STATUS_LINE(task, "Duration:         ",
+                    (unsigned int)profile.tone.durationMs, " ms");
+        STATUS_LINE(task, "Volume (atten):   ",
+                    (unsigned int)profile.tone.attenuation, " dB");
+        if (profile.options.levelTrim) {
+            STATUS_LINE(task, "Calibration:      ",
+                        (int)profile.options.levelTrim, " dB");
+        }
+#if TONE_RAMP_MS
+        STATUS_ROOM(task, 50);
+        Serial.print("Ramps (cos^2):    ");
+        Serial.print(TONE_RAMP_MS);
+        Serial.print(" ms, ");
+        Serial.print(toneRamp.Steps());
+        Serial.print(" steps of ");
+        Serial.print(toneRamp.StepMicros());
+        Serial.println(" us");
+#endif
 
-            toneActive = false;
+        STATUS_TEXT(task, "\n--- HARDWARE CONNECTIONS ---");
+        STATUS_TEXT(task, "Pin 3:  TTL trigger input (from TDT)");
+#if STIMULUS_SELECT_BITS
+        STATUS_LINE(task, "Pin 4-", SELECT_PIN + STIMULUS_SELECT_BITS - 1,
+                    ": stimulus select (bit 0 = pin 4)");
+#endif
+        STATUS_TEXT(task, "Pin 8:  Status LED (ON during tone)");
+        STATUS_TEXT(task, "Audio:  Connect to amplifier/speaker");
+        STATUS_TEXT(task, "Serial: '?' status, 'i' this banner,");
+#ifdef PROBES
+        STATUS_TEXT(task, "        'p' probe histograms,");
+#endif
+        STATUS_TEXT(task, "        binary commands per lib/CommandLink");
+
+        // Where setup() spent its time, phase by phase
+        STATUS_TEXT(task, "\n--- BOOT (us) ---");
+        STATUS_LINE(task, "Core to setup():  ", bootEntryUs, "");
+        for (phase = 0; phase < BOOT_PHASES; phase++) {
+            STATUS_LINE(task, bootPhaseNames[phase],
+                        (bootTicks[phase] -
+                         (phase ? bootTicks[phase - 1] : 0)) /
+                        HAL_TIMER_TICKS_PER_US, "");
         }
+        STATUS_LINE(task, "Trigger ready at: ",
+                    bootTicks[BOOT_TRIGGER] / HAL_TIMER_TICKS_PER_US, "");
+
+        STATUS_TEXT(task, "\n==============================================");
+        STATUS_TEXT(task, "[READY] Waiting for TDT triggers...");
+        STATUS_TEXT(task, "==============================================\n");
+        TASK_SUSPEND(task);         // Until an 'i' arrives
     }
+    PT_END(&task.pt);
+}
 
-    // No delay - keep loop responsive for precise timing
+// =====================================================================
+// MAIN LOOP - One Scheduler Pass
+// =====================================================================
+void loop() {
+    scheduler.RunOnce();
 }
@@ -0,0 +1,84 @@
+// =====================================================================
+// NATIVE SESSION RUNNER
+// =====================================================================
+// Entry point for `pio run -e native`. Runs the real setup()/loop()
+// against the HAL fakes (lib/Hal/HalNative.h) with a few scripted TTL
+// triggers and reports what the bus saw, in virtual CPU cycles.
+// Not built for the board, and not built for `pio test` (Unity brings
+// its own main()).
+// =====================================================================
+
+#if defined(HAL_NATIVE) && !defined(PIO_UNIT_TESTING)
+
+#include <stdio.h>
+#include "Hal.h"
+
+void setup();
+void loop();
+
+#define SESSION_TRIALS   5
+#define SESSION_ITI_MS   1000   // Trigger to trigger
+#define LOOP_IDLE_CYCLES 160    // 10 us of other work per loop() pass
+#define SELECT_FIRST_PIN 4
+#define SELECT_SETUP_CYCLES (F_CPU / 1000UL)
+
+// Run loop() until the virtual clock reaches the given cycle
+static void runUntil(uint64_t end) {
+    while (halFakeCycles() < end) {
+        loop();
+        halFakeAdvance(LOOP_IDLE_CYCLES);
+    }
+}
+
+// Cycle of the first FSYNC/GPIO rising edge after bus log entry 'from'
+static uint64_t firstWordEnd(size_t from) {
+    const std::vector<HalBusEvent> &log = halFakeBusLog();
+    for (size_t i = from; i < log.size(); i++) {
+        if (log[i].bus == HAL_BUS_GPIO && log[i].data == HIGH && i > from &&
+            log[i - 1].bus == HAL_BUS_SPI) {
+            return log[i].cycle;
+        }
+    }
+    return 0;
+}
+
+int main() {
+    halFakeSerialEcho(true);
+
+    setup();
+    printf("\n[native] setup() took %lu us\n",
+           (unsigned long)(halFakeCycles() / HAL_CYCLES_PER_US));
+
+    for (int trial = 0; trial < SESSION_TRIALS; trial++) {
+        // Stimulus select lines (pins 4, 5) count up, set 1 ms before the
+        // edge; firmware without STIMULUS_SELECT_BITS ignores them
+        halFakeSetInput(SELECT_FIRST_PIN, trial & 1);
+        halFakeSetInput(SELECT_FIRST_PIN + 1, (trial >> 1) & 1);
+        runUntil(halFakeCycles() + SELECT_SETUP_CYCLES);
+
+        size_t mark = halFakeBusLog().size();
+        uint64_t edge = halFakeCycles();
+
+        halFakeTrigger();
+        uint64_t onset = firstWordEnd(mark);
+        runUntil(edge + (uint64_t)SESSION_ITI_MS * (F_CPU / 1000UL));
+
+        unsigned spi = 0, i2c = 0;
+        const std::vector<HalBusEvent> &log = halFakeBusLog();
+        for (size_t i = mark; i < log.size(); i++) {
+            if (log[i].bus == HAL_BUS_SPI) spi++;
+            if (log[i].bus == HAL_BUS_I2C) i2c++;
+        }
+
+        printf("[native] trial %d: trigger->onset %lu cycles, "
+               "%u SPI / %u I2C bytes per trial\n", trial + 1,
+               onset ? (unsigned long)(onset - edge) : 0UL, spi, i2c);
+    }
+
+    // Status report over the serial command task
+    halFakeSerialInput("?");
+    runUntil(halFakeCycles() + 100UL * (F_CPU / 1000UL));
+    return 0;
+}
+
+#endif
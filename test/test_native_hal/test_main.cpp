@@ -0,0 +1,980 @@
+#include <unity.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Hal.h"
+#include "AD9833.h"
+#include "AD9833Words.h"
+#include "AD9833Group.h"
+#include "PT2258.h"
+#include "TriggerPlan.h"
+#include "EventLog.h"
+#include "ToneSequence.h"
+#include "ToneRamp.h"
+#include "StimulusSelect.h"
+#include "TriggerQueue.h"
+#include "Scheduler.h"
+#include "CommandLink.h"
+#include "ProfileStore.h"
+#include "Probe.h"
+
+// =====================================================================
+// NATIVE HAL TESTS - drivers and firmware against the recording fakes
+// Run with: pio test -e native
+// =====================================================================
+
+// Firmware entry points from src/main.cpp (test_build_src = yes)
+void setup();
+void loop();
+extern CommandLink commandLink;
+
+#define FNC_PIN 2
+#define PT2258_ADDR7 0x46  // 0x8C >> 1
+
+// Run loop() for the given virtual time, 10 us of other work per pass
+static void runFor(uint32_t us) {
+    uint64_t end = halFakeCycles() + (uint64_t)us * HAL_CYCLES_PER_US;
+    while (halFakeCycles() < end) {
+        loop();
+        halFakeAdvance(160);
+    }
+}
+
+static size_t countI2c(size_t from) {
+    size_t n = 0;
+    const std::vector<HalBusEvent> &log = halFakeBusLog();
+    for (size_t i = from; i < log.size(); i++) {
+        if (log[i].bus == HAL_BUS_I2C) n++;
+    }
+    return n;
+}
+
+// On-time of the last END line in the serial output, -1 if none
+static long lastEndUs(const std::string &out) {
+    size_t at = out.rfind(" END (duration: ");
+    return at == std::string::npos ? -1 : atol(out.c_str() + at + 16);
+}
+
+void setUp(void) {
+    halFakeReset();
+}
+
+void tearDown(void) {
+}
+
+// =====================================================================
+// TEST: AD9833 register words for the 9500 Hz tone
+// =====================================================================
+void test_ad9833_apply_signal_words(void) {
+    AD9833 gen(FNC_PIN);
+    gen.Begin();
+    halFakeClearBusLog();
+
+    uint64_t start = halFakeCycles();
+    gen.ApplySignal(SINE_WAVE, REG0, 9500);
+    gen.EnableOutput(true);
+
+    // One 8 MHz burst for ApplySignal, one word for EnableOutput
+    TEST_ASSERT_EQUAL_UINT(16, halSpiByteCycles());
+    TEST_ASSERT_LESS_THAN(20 * HAL_CYCLES_PER_US, halFakeCycles() - start);
+
+    // 9500 Hz * 2^28 / 25 MHz = 102005 = 0x18E75. The default phase
+    // register SAME_AS_REG0 is written as PHASE1 by SetPhase(). The
+    // unchanged control words of SetWaveform/SetOutputSource are skipped.
+    std::vector<uint16_t> words = halFakeSpiWords();
+    const uint16_t expected[] = { 0x2100, 0x4E75, 0x4006, 0xE000, 0x2000 };
+    TEST_ASSERT_EQUAL_UINT(sizeof(expected) / sizeof(expected[0]), words.size());
+    for (size_t i = 0; i < words.size(); i++) {
+        TEST_ASSERT_EQUAL_HEX16(expected[i], words[i]);
+    }
+}
+
+// =====================================================================
+// TEST: AD9833 shadow registers skip unchanged writes
+// =====================================================================
+void test_ad9833_shadow_skips_unchanged(void) {
+    AD9833 gen(FNC_PIN);
+    gen.Begin();
+    gen.ApplySignal(SINE_WAVE, REG0, 9500);
+    gen.EnableOutput(true);
+    gen.EnableOutput(false);
+    halFakeClearBusLog();
+
+    // Same stimulus again: only the RESET release goes out
+    gen.ApplySignal(SINE_WAVE, REG0, 9500);
+    gen.EnableOutput(true);
+    std::vector<uint16_t> words = halFakeSpiWords();
+    TEST_ASSERT_EQUAL_UINT(1, words.size());
+    TEST_ASSERT_EQUAL_HEX16(0x2000, words[0]);
+
+    // Invalidate() forces the next write, Flush() rewrites everything
+    halFakeClearBusLog();
+    gen.Invalidate(SHADOW_CONTROL);
+    gen.EnableOutput(true);
+    TEST_ASSERT_EQUAL_UINT(1, halFakeSpiWords().size());
+
+    halFakeClearBusLog();
+    gen.Flush();
+    words = halFakeSpiWords();
+    // Control word, 2 x (LSB + MSB), 2 phases
+    TEST_ASSERT_EQUAL_UINT(7, words.size());
+    TEST_ASSERT_EQUAL_HEX16(0x2000, words[0]);
+}
+
+// =====================================================================
+// TEST: Staged signal is switched in with one control word
+// =====================================================================
+void test_ad9833_staged_switch(void) {
+    AD9833 gen(FNC_PIN);
+    gen.Begin();
+    gen.ApplySignal(SINE_WAVE, REG0, 1000);
+    gen.EnableOutput(true);
+    halFakeClearBusLog();
+
+    // Staging goes to FREQ1 / PHASE1 only, the running control word stays
+    TEST_ASSERT_EQUAL(REG1, gen.StagingRegister());
+    gen.StageWords(SINE_WAVE, AD9833Words<9500>::FREQ_WORD,
+                   AD9833Words<9500, 900>::PHASE_VALUE);
+    std::vector<uint16_t> words = halFakeSpiWords();
+    TEST_ASSERT_EQUAL_UINT(3, words.size());
+    TEST_ASSERT_EQUAL_HEX16(AD9833Words<9500>::FREQ1_LSB, words[0]);
+    TEST_ASSERT_EQUAL_HEX16(AD9833Words<9500>::FREQ1_MSB, words[1]);
+    TEST_ASSERT_EQUAL_HEX16(0xE400, words[2]);  // 90 deg into PHASE1
+
+    halFakeClearBusLog();
+    gen.SwitchToStaged();
+    words = halFakeSpiWords();
+    TEST_ASSERT_EQUAL_UINT(1, words.size());
+    TEST_ASSERT_EQUAL_HEX16(0x2000 | FREQ1_OUTPUT_REG | PHASE1_OUTPUT_REG, words[0]);
+    TEST_ASSERT_EQUAL(REG0, gen.StagingRegister());
+}
+
+// =====================================================================
+// TEST: Compile-time FSYNC pin sends the same framed words
+// =====================================================================
+void test_ad9833_fast_pin_same_words(void) {
+    AD9833 gen(FNC_PIN);
+    gen.Begin(false);
+    gen.ApplySignal(SINE_WAVE, REG0, 9500);
+    gen.EnableOutput(true);
+    std::vector<uint16_t> expected = halFakeSpiWords();
+    halFakeClearBusLog();
+
+    AD9833Fast<FNC_PIN> fast;
+    TEST_ASSERT_EQUAL_UINT(HIGH, halFakePin(FNC_PIN));
+    fast.Begin(false);
+    fast.ApplySignal(SINE_WAVE, REG0, 9500);
+    fast.EnableOutput(true);
+    std::vector<uint16_t> words = halFakeSpiWordsTo(FNC_PIN);
+    TEST_ASSERT_EQUAL_UINT(expected.size(), words.size());
+    for (size_t i = 0; i < words.size(); i++) {
+        TEST_ASSERT_EQUAL_HEX16(expected[i], words[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT(HIGH, halFakePin(FNC_PIN));
+    TEST_ASSERT_EQUAL_UINT(25000000UL, (AD9833Fast<FNC_PIN>::REFERENCE_HZ));
+}
+
+// =====================================================================
+// TEST: Grouped AD9833s stage apart and release together
+// =====================================================================
+void test_ad9833_group_release(void) {
+    AD9833 left(2), right(5);
+    AD9833 *channels[] = { &left, &right };
+    const uint8_t pins[] = { 2, 5 };
+    AD9833Group dds(channels, pins, 2);
+    TEST_ASSERT_TRUE(dds.IsBroadcast());
+    dds.Begin(false);
+    halFakeClearBusLog();
+
+    // Each chip gets only its own staged words
+    left.StageWords(SINE_WAVE, AD9833Words<1000>::FREQ_WORD, 0);
+    right.StageWords(SINE_WAVE, AD9833Words<9500>::FREQ_WORD, 0);
+    dds.Release(true);
+    std::vector<uint64_t> leftAt, rightAt;
+    std::vector<uint16_t> l = halFakeSpiWordsTo(2, &leftAt);
+    std::vector<uint16_t> r = halFakeSpiWordsTo(5, &rightAt);
+    const uint16_t release = 0x2000 | FREQ1_OUTPUT_REG | PHASE1_OUTPUT_REG;
+    // B28 (still in RESET), LSB, MSB, PHASE1, then the release
+    TEST_ASSERT_EQUAL_UINT(5, l.size());
+    TEST_ASSERT_EQUAL_UINT(5, r.size());
+    TEST_ASSERT_EQUAL_HEX16(AD9833Words<1000>::FREQ1_LSB, l[1]);
+    TEST_ASSERT_EQUAL_HEX16(AD9833Words<9500>::FREQ1_LSB, r[1]);
+
+    // One broadcast control word, latched by both on the same cycle
+    TEST_ASSERT_EQUAL_HEX16(release, l[4]);
+    TEST_ASSERT_EQUAL_HEX16(release, r[4]);
+    TEST_ASSERT_TRUE(leftAt[4] == rightAt[4]);
+    TEST_ASSERT_EQUAL_UINT(9, halFakeSpiWords().size());
+    TEST_ASSERT_EQUAL_UINT(0, dds.SkewTicks());
+    TEST_ASSERT_EQUAL(REG0, left.StagingRegister());
+
+    // Different waveforms: one word each, a few us apart at most
+    halFakeClearBusLog();
+    left.StageWords(SINE_WAVE, AD9833Words<2000>::FREQ_WORD, 0);
+    right.StageWords(SQUARE_WAVE, AD9833Words<2000>::FREQ_WORD, 0);
+    dds.Release(true);
+    leftAt.clear();
+    rightAt.clear();
+    l = halFakeSpiWordsTo(2, &leftAt);
+    r = halFakeSpiWordsTo(5, &rightAt);
+    TEST_ASSERT_EQUAL_HEX16(0x2000, l.back());
+    TEST_ASSERT_EQUAL_HEX16(SQUARE_WAVE, r.back());
+    uint64_t skew = rightAt.back() - leftAt.back();
+    TEST_ASSERT_LESS_THAN(4 * HAL_CYCLES_PER_US, skew);
+    TEST_ASSERT_UINT_WITHIN(1, skew / (HAL_CYCLES_PER_US / 2), dds.SkewTicks());
+    TEST_ASSERT_EQUAL_UINT(dds.SkewTicks(), dds.MaxSkewTicks());
+
+    // The switch was recorded: nothing left to write
+    halFakeClearBusLog();
+    left.EnableOutput(true);
+    right.EnableOutput(true);
+    TEST_ASSERT_EQUAL_UINT(0, halFakeSpiWords().size());
+    AD9833 far(9);
+    AD9833 *split[] = { &left, &far };
+    const uint8_t splitPins[] = { 2, 9 };
+    TEST_ASSERT_FALSE(AD9833Group(split, splitPins, 2).IsBroadcast());
+}
+
+// =====================================================================
+// TEST: PT2258 attenuation and mute bytes
+// =====================================================================
+void test_pt2258_bytes(void) {
+    PT2258 vol(0x8C);
+    vol.attenuation(1, 20);
+    vol.mute(false);
+
+    const std::vector<HalBusEvent> &log = halFakeBusLog();
+    TEST_ASSERT_EQUAL_UINT(3, log.size());
+    TEST_ASSERT_EQUAL_HEX8(PT2258_ADDR7, log[0].address);
+    TEST_ASSERT_EQUAL_HEX8(PT2258_CH1_10 + 2, log[0].data);
+    TEST_ASSERT_EQUAL_HEX8(PT2258_CH1_1 + 0, log[1].data);
+    TEST_ASSERT_EQUAL_HEX8(PT2258_CHALL_MUTE, log[2].data);
+}
+
+void test_pt2258_shadow_skips_unchanged(void) {
+    PT2258 vol(0x8C);
+    vol.attenuation(1, 20);
+    vol.mute(true);
+    halFakeClearBusLog();
+
+    // Gating mode: repeated level writes are free, mute toggles cost 1 byte
+    vol.attenuation(1, 20);
+    vol.volume(1, 75);          // 79 - 75 * 79 / 100 = 20 dB as well
+    vol.mute(false);
+    vol.mute(false);
+    TEST_ASSERT_EQUAL_UINT(1, countI2c(0));
+
+    // A NACKed write leaves the state unknown, so it is retried
+    halFakeI2cNack(true);
+    vol.mute(true);
+    halFakeI2cNack(false);
+    halFakeClearBusLog();
+    vol.mute(true);
+    TEST_ASSERT_EQUAL_UINT(1, countI2c(0));
+
+    vol.invalidate();
+    vol.attenuation(1, 20);
+    TEST_ASSERT_EQUAL_UINT(3, countI2c(0));
+}
+
+void test_pt2258_queued_mute_returns_at_once(void) {
+    PT2258 vol(0x8C);
+    halI2cSetClock(400000);
+    vol.setAsync(true);
+
+    // 20 bits at 400 kHz = 800 cycles on the bus, the call itself is short
+    uint64_t start = halFakeCycles();
+    vol.mute(false);
+    TEST_ASSERT_LESS_THAN(100, halFakeCycles() - start);
+    TEST_ASSERT_TRUE(vol.busy());
+    TEST_ASSERT_EQUAL_UINT(0, countI2c(0));
+
+    halFakeAdvanceMicros(100);
+    TEST_ASSERT_FALSE(vol.busy());
+    TEST_ASSERT_EQUAL_UINT(1, countI2c(0));
+    TEST_ASSERT_EQUAL_HEX8(PT2258_CHALL_MUTE, halFakeBusLog()[0].data);
+
+    // A NACK is reported by the completion and the write is repeated
+    halFakeI2cNack(true);
+    vol.mute(true);
+    halI2cFlush();
+    halFakeI2cNack(false);
+    TEST_ASSERT_EQUAL_UINT8(1, vol.errors());
+    vol.mute(true);
+    TEST_ASSERT_EQUAL_UINT(1, halI2cPending());
+}
+
+void test_pt2258_begin_reports_nack(void) {
+    PT2258 vol(0x8C);
+    TEST_ASSERT_EQUAL_UINT8(1, vol.begin());
+    halFakeI2cNack(true);
+    TEST_ASSERT_EQUAL_UINT8(0, vol.begin());
+}
+
+// =====================================================================
+// TEST: Raised-cosine ramp paced by the Timer2 ticker
+// =====================================================================
+// src/main.cpp only defines this vector with TONE_RAMP_MS set
+static PT2258 rampVolume(0x8C);
+static ToneRamp testRamp(rampVolume, 1);
+static bool rampDone;
+HAL_TICKER_ISR {
+    if (testRamp.Step()) rampDone = true;
+}
+
+void test_tone_ramp_steps_attenuation(void) {
+    halTimerBegin();
+    halI2cSetClock(400000);
+    rampVolume.invalidate();
+    rampVolume.setAsync(true);
+    testRamp.Begin(5000, 20);
+    TEST_ASSERT_EQUAL_UINT8(25, testRamp.Steps());
+    TEST_ASSERT_EQUAL_UINT16(200, testRamp.StepMicros());
+
+    rampDone = false;
+    testRamp.Start(true);
+    halFakeAdvanceMicros(6000);
+    TEST_ASSERT_TRUE(rampDone);
+    TEST_ASSERT_FALSE(testRamp.IsRunning());
+
+    // Two bytes per update, every one from the ISR, attenuation falling
+    // monotonically to the full level
+    const std::vector<HalBusEvent> &log = halFakeBusLog();
+    TEST_ASSERT_EQUAL_UINT(2 * testRamp.Updates(), log.size());
+    uint8_t previous = RAMP_SILENT;
+    for (size_t i = 0; i < log.size(); i += 2) {
+        uint8_t db = (log[i].data - PT2258_CH1_10) * 10 + (log[i + 1].data - PT2258_CH1_1);
+        TEST_ASSERT_LESS_THAN(previous, db);
+        previous = db;
+    }
+    TEST_ASSERT_EQUAL_UINT8(20, previous);
+    TEST_ASSERT_EQUAL_UINT8(0, testRamp.LateSteps());
+    TEST_ASSERT_UINT_WITHIN(8, 5000, testRamp.MeasuredMicros());
+
+    // The fall ends at the silent level
+    halFakeClearBusLog();
+    testRamp.Start(false);
+    halFakeAdvanceMicros(6000);
+    TEST_ASSERT_EQUAL_HEX8(PT2258_CH1_10 + 7, log[log.size() - 2].data);
+    TEST_ASSERT_EQUAL_HEX8(PT2258_CH1_1 + 9, log[log.size() - 1].data);
+}
+
+// =====================================================================
+// TEST: Armed onset is a single control word
+// =====================================================================
+void test_trigger_plan_onset_is_one_word(void) {
+    TriggerPlan plan(FNC_PIN, 0x8C);
+    StimulusSpec spec;
+    spec.waveType = SINE_WAVE;
+    spec.frequencyInHz = 9500;
+    spec.phaseInDeg = 0.0;
+    spec.channel = 1;
+    spec.attenuation = 20;
+    spec.muteBetweenTrials = false;
+    plan.Compile(spec);
+    plan.Arm();
+    halFakeClearBusLog();
+
+    TEST_ASSERT_TRUE(plan.Fire());
+    TEST_ASSERT_FALSE(plan.Fire());  // Disarmed until re-armed
+
+    std::vector<uint16_t> words = halFakeSpiWords();
+    TEST_ASSERT_EQUAL_UINT(1, words.size());
+    TEST_ASSERT_EQUAL_HEX16(0x2000, words[0]);
+    TEST_ASSERT_EQUAL_UINT(0, countI2c(0));
+    // Past ISR entry and the longest interrupts-off section: one SPI word
+    TEST_ASSERT_LESS_THAN(4 * HAL_CYCLES_PER_US, plan.OnsetBoundCycles() -
+                          PLAN_ISR_ENTRY_CYCLES - PLAN_ISR_BLOCKING_CYCLES);
+
+    // FREQ0 words ahead of Fire() add one word's cycles each
+    uint32_t bound = plan.OnsetBoundCycles();
+    plan.SetPreFireWords(SELECT_MISS_WORDS);
+    TEST_ASSERT_EQUAL_UINT(bound * 3 - 2 * (PLAN_ISR_ENTRY_CYCLES +
+                           PLAN_ISR_BLOCKING_CYCLES), plan.OnsetBoundCycles());
+}
+
+// =====================================================================
+// TEST: Flash sequence steps FREQ0 from Timer1 compare B
+// =====================================================================
+// src/main.cpp only defines this vector with STIMULUS_SEQUENCE enabled
+static ToneSequence testSequence(FNC_PIN);
+HAL_TIMER_COMPARE_B_ISR {
+    testSequence.Step();
+}
+
+static const SeqSegment testSweep[] HAL_FLASH = {
+    seqLinear(1000, 2000, 1000, 100),   // 10 steps of 100 Hz
+    seqLog(2000, 8000, 2000, 100),      // 20 steps, x4 in total
+    seqTone(8000, 500),
+    SEQ_END
+};
+
+static uint32_t wordAt(const std::vector<uint16_t> &words, size_t i) {
+    return (words[i] & 0x3FFF) | ((uint32_t)(words[i + 1] & 0x3FFF) << 14);
+}
+
+void test_tone_sequence_sweeps(void) {
+    halTimerBegin();
+    halSpiBeginTransaction(AD9833_SPI_CLOCK, HAL_SPI_MODE2);
+    halFakeClearBusLog();
+
+    testSequence.ResetStats();
+    testSequence.Start(testSweep);
+    halFakeAdvanceMicros(4000);
+    TEST_ASSERT_FALSE(testSequence.IsRunning());
+
+    // LSB / MSB pairs only, one per step: 10 + 20 + 1
+    std::vector<uint16_t> words = halFakeSpiWords();
+    TEST_ASSERT_EQUAL_UINT(2 * 31, words.size());
+    for (size_t i = 0; i < words.size(); i++) {
+        TEST_ASSERT_EQUAL_HEX16(FREQ0_WRITE_REG, words[i] & 0xC000);
+    }
+    TEST_ASSERT_EQUAL_UINT32(ad9833FreqWord(1000), wordAt(words, 0));
+    TEST_ASSERT_EQUAL_UINT32(ad9833FreqWord(1000) +
+                             9 * (uint32_t)testSweep[0].delta, wordAt(words, 18));
+
+    // The log sweep compounds integer steps: its last one (19 of 20 ratio
+    // steps above 2 kHz) stays within 0.5 % of 2000 * 4^(19/20) Hz
+    double expected = ad9833FreqWord(2000) * pow(4.0, 19.0 / 20.0);
+    TEST_ASSERT_UINT32_WITHIN((uint32_t)(expected / 200), (uint32_t)expected,
+                              wordAt(words, 58));
+    TEST_ASSERT_EQUAL_UINT32(ad9833FreqWord(8000), wordAt(words, 60));
+
+    // Service time leaves room for well above 10 kHz updates
+    TEST_ASSERT_EQUAL_UINT(0, testSequence.Overruns());
+    TEST_ASSERT_GREATER_THAN(10000, testSequence.MaxUpdateRateHz());
+    halSpiEndTransaction();
+}
+
+// A long chirp: 2000 ratio steps from 1 kHz up four octaves
+static const SeqSegment testLongSweep[] HAL_FLASH = {
+    seqLog(1000, 16000, 400000, 200),
+    seqTone(16000, 500),
+    SEQ_END
+};
+
+void test_tone_sequence_long_log_sweep(void) {
+    halTimerBegin();
+    halSpiBeginTransaction(AD9833_SPI_CLOCK, HAL_SPI_MODE2);
+    halFakeClearBusLog();
+
+    testSequence.Start(testLongSweep);
+    halFakeAdvanceMicros(402000);
+    TEST_ASSERT_FALSE(testSequence.IsRunning());
+    std::vector<uint16_t> words = halFakeSpiWords();
+    TEST_ASSERT_EQUAL_UINT(2 * 2001, words.size());
+
+    // Step k is 1000 * 16^(k / 2000) Hz to within a word: neither the
+    // ratio nor the per-step products lose bits that add up
+    const size_t steps[] = { 500, 1000, 1999 };
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        double expected = ad9833FreqWord(1000) * pow(16.0, steps[i] / 2000.0);
+        TEST_ASSERT_UINT32_WITHIN(1, (uint32_t)(expected + 0.5),
+                                  wordAt(words, 2 * steps[i]));
+    }
+    TEST_ASSERT_EQUAL_UINT32(ad9833FreqWord(16000), wordAt(words, 4000));
+    halSpiEndTransaction();
+}
+
+// =====================================================================
+// TEST: Select lines pick the stimulus; prepared ones add no onset word
+// =====================================================================
+void test_stimulus_select_prepared_and_late(void) {
+    StimulusEntry table[4] = {
+        stimulusEntry(9500, 20, 350),
+        stimulusEntry(4000, 20, 350),
+        stimulusEntry(9500, 30, 350),
+        stimulusEntry(4000, 30, 200),
+    };
+    StimulusSelect select(FNC_PIN, 4, 2, table);
+    select.Begin();
+    halFakeSetInput(4, HIGH);   // index 1
+    halFakeClearBusLog();
+
+    TEST_ASSERT_TRUE(select.Prepare());
+    TEST_ASSERT_FALSE(select.Prepare());
+    std::vector<uint16_t> words = halFakeSpiWords();
+    TEST_ASSERT_EQUAL_UINT(2, words.size());
+    TEST_ASSERT_EQUAL_HEX16(AD9833Words<4000>::FREQ0_LSB, words[0]);
+    TEST_ASSERT_EQUAL_HEX16(AD9833Words<4000>::FREQ0_MSB, words[1]);
+
+    // Prepared: the ISR lookup writes nothing
+    halFakeClearBusLog();
+    const StimulusEntry &e = select.Select();
+    TEST_ASSERT_EQUAL_UINT16(4000, e.frequencyHz);
+    TEST_ASSERT_EQUAL_UINT(0, halFakeSpiWords().size());
+    TEST_ASSERT_EQUAL_UINT16(0, select.Misses());
+
+    // Lines changed at the edge: the words go out from the ISR
+    halFakeSetInput(5, HIGH);   // index 3
+    const StimulusEntry &late = select.Select();
+    TEST_ASSERT_EQUAL_UINT8(3, select.Selected());
+    TEST_ASSERT_EQUAL_UINT8(30, late.attenuation);
+    TEST_ASSERT_EQUAL_UINT32(200000UL * HAL_TIMER_TICKS_PER_US, late.durationTicks);
+    TEST_ASSERT_EQUAL_UINT(2, halFakeSpiWords().size());
+    TEST_ASSERT_EQUAL_UINT16(1, select.Misses());
+}
+
+// =====================================================================
+// TEST: Compile-time words match the float path
+// =====================================================================
+// 9500 Hz * 2^28 / 25 MHz = 102005.47, rounded to 0x18E75
+static_assert(AD9833Words<9500>::FREQ0_LSB == 0x4E75, "FREQ0 LSB");
+static_assert(AD9833Words<9500>::FREQ0_MSB == 0x4006, "FREQ0 MSB");
+static_assert(AD9833Words<9500, 900>::PHASE1 == 0xE400, "90 deg in PHASE1");
+static_assert(AD9833Words<9500, 0, SQUARE_WAVE>::CONTROL_RESET == 0x2128,
+              "square wave held in RESET");
+
+void test_ad9833_words_match_float_plan(void) {
+    typedef AD9833Words<9500, 450> Tone;
+    StimulusSpec spec;
+    spec.waveType = SINE_WAVE;
+    spec.frequencyInHz = 9500;
+    spec.phaseInDeg = 45.0;
+    spec.channel = 1;
+    spec.attenuation = 20;
+    spec.muteBetweenTrials = false;
+    StimulusWords words;
+    words.control = Tone::CONTROL;
+    words.freqLsb = Tone::FREQ0_LSB;
+    words.freqMsb = Tone::FREQ0_MSB;
+    words.phase = Tone::PHASE0;
+    words.channel = 1;
+    words.attenuation = 20;
+    words.muteBetweenTrials = false;
+
+    TriggerPlan floatPlan(FNC_PIN, 0x8C), wordPlan(FNC_PIN, 0x8C);
+    floatPlan.Compile(spec);
+    wordPlan.Compile(words);
+
+    // The float path truncates, the constexpr path rounds: at most 1 LSB
+    const PlanTable &a = floatPlan.ArmTable(), &b = wordPlan.ArmTable();
+    TEST_ASSERT_EQUAL_UINT(a.count, b.count);
+    for (uint8_t i = 0; i < a.count; i++) {
+        TEST_ASSERT_EQUAL_HEX8(a.step[i].b0, b.step[i].b0);
+        TEST_ASSERT_UINT_WITHIN(1, a.step[i].b1, b.step[i].b1);
+    }
+    TEST_ASSERT_EQUAL_HEX8(highByte(Tone::CONTROL), wordPlan.OnsetTable().step[0].b0);
+    TEST_ASSERT_EQUAL_HEX8(lowByte(Tone::CONTROL), wordPlan.OnsetTable().step[0].b1);
+}
+
+// =====================================================================
+// TEST: Event log never blocks and counts overruns
+// =====================================================================
+void test_event_log_overrun_counted(void) {
+    EventLog log;
+    for (int i = 0; i < LOG_CAPACITY + 4; i++) {
+        log.Push(LOG_TONE_START, i, 9500);
+    }
+    // One slot is kept free to tell full from empty
+    TEST_ASSERT_EQUAL_UINT(5, log.Overruns());
+
+    Serial.begin(115200);
+    uint64_t before = halFakeCycles();
+    log.Drain(Serial);
+    // Only the TX buffer room is written, never a blocking wait for the
+    // rest of the 16 lines (~600 bytes, ~0.8 M cycles at 115200 baud)
+    TEST_ASSERT_GREATER_THAN(0, halFakeSerialOutput().size());
+    TEST_ASSERT_LESS_THAN(70 * 100, halFakeCycles() - before);
+    TEST_ASSERT_FALSE(log.IsIdle());
+}
+
+// =====================================================================
+// TEST: retrigger policies keep edges in order and count every loss
+// =====================================================================
+void test_trigger_queue_policies(void) {
+    TriggerEvent e = { 0, 0 };
+    TriggerEvent out;
+
+    TriggerQueue drop(TRIGGER_DROP);
+    TEST_ASSERT_EQUAL_UINT(TRIGGER_DROPPED, drop.Offer(e, true));
+    TEST_ASSERT_EQUAL_UINT(TRIGGER_QUEUED, drop.Offer(e, false));  // re-arm window
+    TEST_ASSERT_EQUAL_UINT(1, drop.Dropped());
+
+    TriggerQueue queue(TRIGGER_QUEUE);
+    for (int i = 0; i < TRIGGER_QUEUE_SIZE; i++) {
+        e.time = i;
+        queue.Offer(e, true);
+    }
+    // One slot is kept free to tell full from empty
+    TEST_ASSERT_EQUAL_UINT(TRIGGER_QUEUE_SIZE - 1, queue.Queued());
+    TEST_ASSERT_EQUAL_UINT(1, queue.Dropped());
+    for (int i = 0; i < TRIGGER_QUEUE_SIZE - 1; i++) {
+        TEST_ASSERT_TRUE(queue.Take(out));
+        TEST_ASSERT_EQUAL_UINT32(i, (uint32_t)out.time);
+    }
+    TEST_ASSERT_FALSE(queue.Take(out));
+
+    TriggerQueue restart(TRIGGER_RESTART);
+    e.time = 1;
+    TEST_ASSERT_EQUAL_UINT(TRIGGER_QUEUED, restart.Offer(e, true));
+    e.time = 2;
+    TEST_ASSERT_EQUAL_UINT(TRIGGER_COALESCED, restart.Offer(e, true));
+    TEST_ASSERT_EQUAL_UINT(1, restart.Coalesced());
+    TEST_ASSERT_TRUE(restart.Take(out));
+    TEST_ASSERT_EQUAL_UINT32(1, (uint32_t)out.time);
+    TEST_ASSERT_TRUE(restart.IsEmpty());
+}
+
+// =====================================================================
+// TEST: timer wheel wakes sleepers on their tick, also past a full turn
+// =====================================================================
+static Scheduler testScheduler;
+static uint16_t wokeAt[4];
+static uint8_t wakes;
+
+static PT_THREAD(sleeper(Task &task)) {
+    PT_BEGIN(&task.pt);
+    TASK_SLEEP(task, 3);
+    wokeAt[wakes++] = testScheduler.Now();
+    TASK_SLEEP(task, SCHED_WHEEL_SIZE + 5);     // same slot, next turn
+    wokeAt[wakes++] = testScheduler.Now();
+    TASK_SUSPEND(task);
+    wokeAt[wakes++] = testScheduler.Now();
+    PT_END(&task.pt);
+}
+
+void test_scheduler_wheel_wakes_on_tick(void) {
+    Task task(sleeper);
+    wakes = 0;
+    halTimerBegin();
+    testScheduler.Begin();
+    testScheduler.Add(task);
+
+    for (int i = 0; i < 400; i++) {             // 100 us passes, 40 ticks
+        testScheduler.RunOnce();
+        halFakeAdvanceMicros(100);
+    }
+    TEST_ASSERT_EQUAL_UINT(2, wakes);
+    TEST_ASSERT_EQUAL_UINT(3, wokeAt[0]);
+    TEST_ASSERT_EQUAL_UINT(3 + SCHED_WHEEL_SIZE + 5, wokeAt[1]);
+    TEST_ASSERT_EQUAL_UINT(TASK_SUSPENDED, task.State());
+
+    testScheduler.Wake(task);
+    testScheduler.RunOnce();
+    TEST_ASSERT_EQUAL_UINT(3, wakes);
+    TEST_ASSERT_EQUAL_UINT(TASK_ENDED, task.State());
+    TEST_ASSERT_EQUAL_UINT32(401, testScheduler.Passes());
+}
+
+// =====================================================================
+// TEST: 16 bit snapshots extend across Timer1 wraps; log in seconds
+// =====================================================================
+void test_timebase_extends_snapshots(void) {
+    halTimerBegin();
+    halFakeAdvanceMicros(40000);            // past one 32.768 ms wrap
+    uint64_t at = halTimerTicks64();
+    uint16_t snapshot = halTimerNow();
+    TEST_ASSERT_EQUAL_UINT32(40000UL * HAL_TIMER_TICKS_PER_US, (uint32_t)at);
+
+    halFakeAdvanceMicros(30000);            // and across the next one
+    TEST_ASSERT_TRUE(halTimerExtend(snapshot) == at);
+
+    EventLog log;
+    log.Push(LOG_TONE_START, 1, 9500, at + 1);
+    Serial.begin(115200);
+    log.Drain(Serial);
+    TEST_ASSERT_NOT_NULL(strstr(halFakeSerialOutput().c_str(),
+                                "[0.0400005 s] Tone #1 START"));
+}
+
+// =====================================================================
+// TEST: Firmware plays the onset from the ISR and gates 350 ms
+// =====================================================================
+void test_firmware_trigger_to_offset(void) {
+    setup();
+    runFor(1000);
+    halFakeClearBusLog();
+    halFakeClearSerial();
+
+    uint64_t edge = halFakeCycles();
+    halFakeTrigger();
+    std::vector<uint16_t> onset = halFakeSpiWords();
+    TEST_ASSERT_EQUAL_UINT(1, onset.size());
+    TEST_ASSERT_EQUAL_HEX16(0x2000, onset[0]);
+    TEST_ASSERT_LESS_THAN(10 * HAL_CYCLES_PER_US, halFakeCycles() - edge);
+
+    runFor(400000);
+
+    // The RESET word goes out 350 ms after the onset word
+    const std::vector<HalBusEvent> &log = halFakeBusLog();
+    uint64_t offsetCycle = 0;
+    for (size_t i = 0; i < log.size(); i++) {
+        if (log[i].bus == HAL_BUS_SPI && log[i].fromIsr &&
+            log[i].cycle > edge + HAL_CYCLES_PER_US * 1000) {
+            offsetCycle = log[i].cycle;
+            break;
+        }
+    }
+    TEST_ASSERT_UINT_WITHIN(10 * HAL_CYCLES_PER_US,
+                            350000UL * HAL_CYCLES_PER_US, offsetCycle - edge);
+
+    const char *out = halFakeSerialOutput().c_str();
+    TEST_ASSERT_NOT_NULL(strstr(out, " START (9500 Hz)"));
+    TEST_ASSERT_INT_WITHIN(1, 350000, lastEndUs(out));
+}
+
+// =====================================================================
+// TEST: A scheduled edge waits out interrupts-off code, like INT1's flag
+// =====================================================================
+void test_firmware_trigger_at_latched(void) {
+    setup();
+    runFor(1000);
+    halFakeClearBusLog();
+    halFakeClearSerial();
+
+    // Two edges while interrupts are off: one flag, one tone
+    uint64_t edge = halFakeCycles() + 100;
+    halFakeTriggerAt(edge);
+    halFakeTriggerAt(edge + 50);
+    HalIrqState state = halIrqSave();
+    halFakeAdvance(400);
+    TEST_ASSERT_EQUAL_UINT(0, halFakeSpiWords().size());
+    uint64_t restored = halFakeCycles();
+    halIrqRestore(state);
+
+    std::vector<uint64_t> cycles;
+    std::vector<uint16_t> onset = halFakeSpiWordsTo(FNC_PIN, &cycles);
+    TEST_ASSERT_EQUAL_UINT(1, onset.size());
+    TEST_ASSERT_EQUAL_HEX16(0x2000, onset[0]);
+    TEST_ASSERT_TRUE(cycles[0] > restored);
+
+    // With interrupts on, the next one is taken on its cycle
+    runFor(400000);
+    halFakeClearBusLog();
+    edge = halFakeCycles() + 1000;
+    halFakeTriggerAt(edge);
+    runFor(100);
+    onset = halFakeSpiWordsTo(FNC_PIN, &cycles);
+    TEST_ASSERT_EQUAL_UINT(1, onset.size());
+    TEST_ASSERT_LESS_THAN(10 * HAL_CYCLES_PER_US, cycles[0] - edge);
+    runFor(400000);
+    TEST_ASSERT_NULL(strstr(halFakeSerialOutput().c_str(), "DROPPED"));
+}
+
+// =====================================================================
+// TEST: Probe histograms of one trial, dumped on 'p'
+// =====================================================================
+void test_firmware_probes(void) {
+    TEST_ASSERT_EQUAL_UINT(0, ProbeHistogram::Bucket(0));
+    TEST_ASSERT_EQUAL_UINT(1, ProbeHistogram::Bucket(1));
+    TEST_ASSERT_EQUAL_UINT(9, ProbeHistogram::Bucket(256));
+    TEST_ASSERT_EQUAL_UINT(PROBE_BUCKETS - 1, ProbeHistogram::Bucket(0xFFFF));
+
+    setup();
+    runFor(300000);
+    for (uint8_t i = 0; i < PROBE_COUNT; i++) probes[i].Clear();
+    halFakeClearSerial();
+
+    halFakeTrigger();
+    runFor(400000);
+
+    // Armed: the onset word goes out from the ISR, a few us after entry
+    TEST_ASSERT_EQUAL_UINT(1, probes[PROBE_ISR].count);
+    TEST_ASSERT_EQUAL_UINT(1, probes[PROBE_ONSET].count);
+    TEST_ASSERT_EQUAL_UINT(1, probes[PROBE_PICKUP].count);
+    TEST_ASSERT_LESS_THAN(20, probes[PROBE_ONSET].max);
+    TEST_ASSERT_TRUE(probes[PROBE_ONSET].max <= probes[PROBE_ISR].min);
+    TEST_ASSERT_TRUE(probes[PROBE_ISR].max <= probes[PROBE_PICKUP].min);
+
+    halFakeSerialInput("p");
+    runFor(100000);
+    const char *out = halFakeSerialOutput().c_str();
+    TEST_ASSERT_NOT_NULL(strstr(out, "--- PROBES (Timer1 ticks, 0.5 us) ---"));
+    TEST_ASSERT_NOT_NULL(strstr(out, "isr: n=1 min="));
+    TEST_ASSERT_NOT_NULL(strstr(out, "pickup: n=1 min="));
+    TEST_ASSERT_EQUAL_UINT(0, probes[PROBE_ISR].count);    // Cleared
+}
+
+// =====================================================================
+// TEST: Fast boot: silent and armed within 1 ms, banner afterwards
+// =====================================================================
+void test_firmware_fast_boot(void) {
+    setup();
+    TEST_ASSERT_LESS_THAN(1000UL * HAL_CYCLES_PER_US, halFakeCycles());
+    TEST_ASSERT_EQUAL_HEX16(0x0100, halFakeSpiWords()[0]);  // RESET first
+    TEST_ASSERT_EQUAL_UINT(0, halFakeSerialOutput().size());
+
+    // An edge right after setup() plays, while the banner goes out
+    halFakeClearBusLog();
+    halFakeTrigger();
+    TEST_ASSERT_EQUAL_HEX16(0x2000, halFakeSpiWords()[0]);
+    runFor(500000);             // Tone, then the banner
+    const char *out = halFakeSerialOutput().c_str();
+    TEST_ASSERT_NOT_NULL(strstr(out, "[READY] Waiting for TDT triggers..."));
+    TEST_ASSERT_NOT_NULL(strstr(out, "Trigger ready at: "));
+    TEST_ASSERT_INT_WITHIN(1, 350000, lastEndUs(out));
+}
+
+// =====================================================================
+// TEST: After power-on the chips get their settle time before any write
+// =====================================================================
+void test_firmware_power_on_boot_settles(void) {
+    halFakePowerOn();
+    setup();
+    const std::vector<HalBusEvent> &log = halFakeBusLog();
+    uint64_t firstI2c = 0, firstSpi = 0;
+    for (size_t i = 0; i < log.size(); i++) {
+        if (log[i].bus == HAL_BUS_I2C && !firstI2c) firstI2c = log[i].cycle;
+        if (log[i].bus == HAL_BUS_SPI && !firstSpi) firstSpi = log[i].cycle;
+    }
+    TEST_ASSERT_EQUAL_HEX16(0x0100, halFakeSpiWords()[0]);  // RESET first
+    TEST_ASSERT_TRUE(firstSpi >= 100000UL * HAL_CYCLES_PER_US);
+    TEST_ASSERT_TRUE(firstI2c >= 115000UL * HAL_CYCLES_PER_US);
+
+    halFakeClearBusLog();
+    halFakeTrigger();
+    TEST_ASSERT_EQUAL_HEX16(0x2000, halFakeSpiWords()[0]);
+    runFor(400000);
+}
+
+// =====================================================================
+// TEST: Serial SET_TONE waits for the end of the tone in flight
+// =====================================================================
+static std::string linkFrame(uint8_t command, const uint8_t *payload,
+                             uint8_t length) {
+    uint8_t frame[LINK_MAX_FRAME];
+    uint8_t n = CommandLink::Encode(frame, command, payload, length);
+    return std::string((const char *)frame, n);
+}
+
+void test_firmware_set_tone_between_trials(void) {
+    setup();
+    runFor(1000);
+    halFakeTrigger();
+    runFor(100000);
+    halFakeClearSerial();
+
+    // 4000 Hz, 100 ms, 30 dB; then one frame with a bad CRC
+    uint8_t set[8] = { 0 };
+    CommandLink::Put16(CommandLink::Put32(set + 1, 4000), 100);
+    set[7] = 30;
+    std::string corrupt = linkFrame(LINK_PING, 0, 0);
+    corrupt[corrupt.size() - 1] ^= 1;
+    halFakeSerialInput(linkFrame(LINK_SET_TONE, set, 8) + corrupt);
+    runFor(20000);
+
+    uint8_t ok[LINK_MAX_FRAME];
+    uint8_t n = CommandLink::Reply(ok, LINK_SET_TONE, LINK_OK);
+    TEST_ASSERT_TRUE(halFakeSerialOutput().find(
+        std::string((const char *)ok, n)) != std::string::npos);
+
+    // The running tone keeps its 350 ms and its frequency words
+    halFakeClearBusLog();
+    runFor(300000);
+    std::vector<uint16_t> words = halFakeSpiWords();
+    TEST_ASSERT_EQUAL_HEX16(0x2100, words[0]);          // offset: RESET
+    TEST_ASSERT_EQUAL_HEX16(ad9833FreqLsb(ad9833FreqWord(4000)), words[2]);
+    TEST_ASSERT_INT_WITHIN(1, 350000,           // after the binary reply
+                           lastEndUs(halFakeSerialOutput()));
+
+    halFakeClearSerial();
+    halFakeTrigger();
+    runFor(150000);
+    const char *out = halFakeSerialOutput().c_str();
+    TEST_ASSERT_NOT_NULL(strstr(out, " START (4000 Hz)"));
+    TEST_ASSERT_INT_WITHIN(1, 100000, lastEndUs(out));
+    TEST_ASSERT_EQUAL_UINT(1, commandLink.Errors());
+}
+
+// =====================================================================
+// TEST: A saved profile is loaded at boot, a corrupted one is not
+// =====================================================================
+void test_firmware_profile_saved_and_loaded(void) {
+    halFakeEepromErase();
+    setup();
+    runFor(1000);
+
+    // 6000 Hz, 200 ms, 25 dB, then save it
+    uint8_t set[8] = { 0 };
+    CommandLink::Put16(CommandLink::Put32(set + 1, 6000), 200);
+    set[7] = 25;
+    halFakeSerialInput(linkFrame(LINK_SET_TONE, set, 8));
+    runFor(20000);
+    uint8_t slot = 0;
+    halFakeClearSerial();
+    halFakeSerialInput(linkFrame(LINK_SAVE_PROFILE, &slot, 1));
+    runFor(500000);
+    uint8_t ok[LINK_MAX_FRAME];
+    uint8_t n = CommandLink::Reply(ok, LINK_SAVE_PROFILE, LINK_OK);
+    TEST_ASSERT_TRUE(halFakeSerialOutput().find(
+        std::string((const char *)ok, n)) != std::string::npos);
+
+    // Reboot with other settings in RAM: the saved tone comes back
+    CommandLink::Put32(set + 1, 5000);
+    halFakeSerialInput(linkFrame(LINK_SET_TONE, set, 8));
+    runFor(20000);
+    halFakeReset();
+    setup();
+    runFor(150000);             // Boot banner
+    const char *out = halFakeSerialOutput().c_str();
+    TEST_ASSERT_NOT_NULL(strstr(out, "[INIT] Profile 0: loaded ("));
+    TEST_ASSERT_NOT_NULL(strstr(out, "Frequency:        6000 Hz"));
+    TEST_ASSERT_NOT_NULL(strstr(out,
+        "===   Pure Tone: 6000 Hz, 200 ms          ===\r\n"));
+    halFakeClearSerial();
+    runFor(1000);
+    halFakeTrigger();
+    runFor(250000);
+    out = halFakeSerialOutput().c_str();
+    TEST_ASSERT_NOT_NULL(strstr(out, " START (6000 Hz)"));
+    TEST_ASSERT_INT_WITHIN(1, 200000, lastEndUs(out));
+
+    // One flipped bit in the body: the CRC check keeps what is in RAM
+    halFakeEeprom()[sizeof(ProfileHeader) + 1] ^= 0x01;
+    halFakeReset();
+    setup();
+    runFor(150000);
+    TEST_ASSERT_NOT_NULL(strstr(halFakeSerialOutput().c_str(),
+                                "[INIT] Profile 0: bad CRC, using defaults"));
+    halFakeEepromErase();
+}
+
+// =====================================================================
+// TEST: Edges during a tone do not restart it
+// =====================================================================
+void test_firmware_retrigger_ignored(void) {
+    setup();
+    runFor(1000);
+    halFakeTrigger();
+    runFor(100000);
+    halFakeClearBusLog();
+
+    halFakeTrigger();
+    TEST_ASSERT_EQUAL_UINT(0, halFakeSpiWords().size());
+    runFor(300000);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_ad9833_apply_signal_words);
+    RUN_TEST(test_ad9833_shadow_skips_unchanged);
+    RUN_TEST(test_ad9833_staged_switch);
+    RUN_TEST(test_ad9833_fast_pin_same_words);
+    RUN_TEST(test_ad9833_group_release);
+    RUN_TEST(test_pt2258_bytes);
+    RUN_TEST(test_pt2258_shadow_skips_unchanged);
+    RUN_TEST(test_pt2258_queued_mute_returns_at_once);
+    RUN_TEST(test_pt2258_begin_reports_nack);
+    RUN_TEST(test_tone_ramp_steps_attenuation);
+    RUN_TEST(test_trigger_plan_onset_is_one_word);
+    RUN_TEST(test_tone_sequence_sweeps);
+    RUN_TEST(test_tone_sequence_long_log_sweep);
+    RUN_TEST(test_stimulus_select_prepared_and_late);
+    RUN_TEST(test_ad9833_words_match_float_plan);
+    RUN_TEST(test_event_log_overrun_counted);
+    RUN_TEST(test_trigger_queue_policies);
+    RUN_TEST(test_scheduler_wheel_wakes_on_tick);
+    RUN_TEST(test_timebase_extends_snapshots);
+    RUN_TEST(test_firmware_trigger_to_offset);
+    RUN_TEST(test_firmware_trigger_at_latched);
+    RUN_TEST(test_firmware_fast_boot);
+    RUN_TEST(test_firmware_power_on_boot_settles);
+    RUN_TEST(test_firmware_probes);
+    RUN_TEST(test_firmware_retrigger_ignored);
+    RUN_TEST(test_firmware_set_tone_between_trials);
+    RUN_TEST(test_firmware_profile_saved_and_loaded);
+
+    return UNITY_END();
+}
@@ -0,0 +1,135 @@
+#include <unity.h>
+#include <string>
+#include "Hal.h"
+#include "PT2258.h"
+#include "CommandLink.h"
+#include "TriggerQueue.h"
+
+// =====================================================================
+// NATIVE SELECT TESTS - main.cpp with stimulus select lines
+// Run with: pio test -e native_select (STIMULUS_SELECT_BITS=2)
+// =====================================================================
+
+void setup();
+void loop();
+
+#define SELECT_PIN 4
+#define VOLUME_ATTENUATION 20  // main.cpp default level
+
+static void runFor(uint32_t us) {
+    uint64_t end = halFakeCycles() + (uint64_t)us * HAL_CYCLES_PER_US;
+    while (halFakeCycles() < end) {
+        loop();
+        halFakeAdvance(160);
+    }
+}
+
+static std::string linkFrame(uint8_t command, const uint8_t *payload,
+                             uint8_t length) {
+    uint8_t frame[LINK_MAX_FRAME];
+    uint8_t n = CommandLink::Encode(frame, command, payload, length);
+    return std::string((const char *)frame, n);
+}
+
+static void selectIndex(uint8_t index) {
+    halFakeSetInput(SELECT_PIN, index & 1);
+    halFakeSetInput(SELECT_PIN + 1, (index >> 1) & 1);
+}
+
+// Channel 1 levels written to the PT2258 since bus log entry 'from'
+static std::vector<uint8_t> channel1Levels(size_t from) {
+    std::vector<uint8_t> levels;
+    const std::vector<HalBusEvent> &log = halFakeBusLog();
+    for (size_t i = from; i + 1 < log.size(); i++) {
+        if (log[i].bus != HAL_BUS_I2C || log[i + 1].bus != HAL_BUS_I2C) continue;
+        uint8_t tens = log[i].data - PT2258_CH1_10;
+        uint8_t ones = log[i + 1].data - PT2258_CH1_1;
+        if (tens < 8 && ones < 10) levels.push_back(tens * 10 + ones);
+    }
+    return levels;
+}
+
+void setUp(void) {
+    halFakeReset();
+}
+
+void tearDown(void) {
+}
+
+// =====================================================================
+// TEST: A trimmed profile's arm levels do not leave the PT2258 driver
+// with a stale level for the select path
+// =====================================================================
+void test_select_level_after_trimmed_profile(void) {
+    halFakeEepromErase();
+    selectIndex(0);
+    setup();
+    runFor(150000);
+
+    // -10 dB speaker trim, saved to slot 0
+    uint8_t options[3] = { (uint8_t)-10, 0, TRIGGER_DROP };
+    halFakeSerialInput(linkFrame(LINK_SET_OPTIONS, options, 3));
+    runFor(20000);
+    uint8_t slot = 0;
+    halFakeSerialInput(linkFrame(LINK_SAVE_PROFILE, &slot, 1));
+    runFor(500000);
+
+    // Reboot with entry 2 (VOLUME_ATTENUATION + 10) on the lines: trimmed,
+    // it plays at VOLUME_ATTENUATION, the level setup() left in the driver
+    halFakeReset();
+    selectIndex(2);
+    setup();
+    size_t mark = halFakeBusLog().size();
+    runFor(150000);
+    TEST_ASSERT_TRUE(halFakeSerialOutput().find("[INIT] Profile 0: loaded (") !=
+                     std::string::npos);
+
+    // The arm table set the trimmed tone level behind the driver's back;
+    // the select path then has to put the entry's level on the chip
+    std::vector<uint8_t> levels = channel1Levels(0);
+    TEST_ASSERT_FALSE(levels.empty());
+    TEST_ASSERT_EQUAL_UINT(VOLUME_ATTENUATION, levels.back());
+    levels = channel1Levels(mark);
+    TEST_ASSERT_EQUAL_UINT(1, levels.size());
+    halFakeEepromErase();
+}
+
+// =====================================================================
+// TEST: GET_TONE answers for select entries only
+// =====================================================================
+static bool replied(uint8_t command, uint8_t status, const uint8_t *data,
+                    uint8_t length) {
+    uint8_t reply[LINK_MAX_FRAME];
+    uint8_t n = CommandLink::Reply(reply, command, status, data, length);
+    return halFakeSerialOutput().find(std::string((const char *)reply, n)) !=
+           std::string::npos;
+}
+
+void test_get_tone_index_range(void) {
+    selectIndex(0);
+    setup();
+    runFor(150000);
+    halFakeClearSerial();
+
+    // Entry 3: 4000 Hz, 350 ms, VOLUME_ATTENUATION + 10, no update pending
+    uint8_t index = 3;
+    halFakeSerialInput(linkFrame(LINK_GET_TONE, &index, 1));
+    runFor(20000);
+    uint8_t tone[9] = { 3 };
+    CommandLink::Put16(CommandLink::Put32(tone + 1, 4000), 350);
+    tone[7] = VOLUME_ATTENUATION + 10;
+    TEST_ASSERT_TRUE(replied(LINK_GET_TONE, LINK_OK, tone, 9));
+
+    // Index 4 would wrap to entry 0 in the select mask
+    index = 4;
+    halFakeSerialInput(linkFrame(LINK_GET_TONE, &index, 1));
+    runFor(20000);
+    TEST_ASSERT_TRUE(replied(LINK_GET_TONE, LINK_BAD_VALUE, 0, 0));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_select_level_after_trimmed_profile);
+    RUN_TEST(test_get_tone_index_range);
+    return UNITY_END();
+}
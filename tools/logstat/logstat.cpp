@@ -0,0 +1,430 @@
+// =====================================================================
+// EVENT LOG DECODER AND TRIAL STATISTICS (host)
+// =====================================================================
+// Reads the firmware's serial stream (lib/EventLog lines, with binary
+// lib/CommandLink replies mixed in) from a file, a pipe, a pty or the
+// serial port itself, as it arrives, and rebuilds one record per trial:
+//
+//   [12.3456789 s] Tone #5 TRIGGER (onset +2.5 us)
+//   [12.3456814 s] Tone #5 START (9500 Hz)
+//   [12.6956850 s] Tone #5 END (duration: 350004 us)
+//
+// Single pass, constant memory: only the trial in progress is kept, and
+// every statistic is a running sum plus a fixed log-linear histogram
+// (2^HIST_SUB_BITS buckets per octave of deviation, see Stats), so a
+// session of any length runs in the same few hundred KB. Reported:
+//   onset     - edge to onset word, from the TRIGGER line
+//   duration  - firmware-measured on-time, from the END line, and its
+//               error against --duration-ms
+//   iti       - trigger to trigger, within one boot of the firmware
+// plus dropped / coalesced triggers, restarted trials, trials lost to
+// log overruns (gaps in the tone numbers) and firmware reboots. Dropped
+// and coalesced come from the firmware's running "(N total)" counts, so
+// edges whose lines a log overrun lost are still counted.
+//
+// Usage:
+//   logstat [FILE | DEVICE | -] [options]      (default: stdin)
+//     --duration-ms MS  expected tone duration (default 350)
+//     --csv FILE        one line per trial, written as trials complete
+//     --every N         print the summary every N trials
+//     --baud B          serial speed when the input is a tty (115200)
+//
+// Ctrl-C (or EOF) ends the session and prints the summary. Build with
+//   pio run -e logstat && .pio/build/logstat/program session.log
+// or on its own: g++ -O2 -std=c++11 -o logstat tools/logstat/logstat.cpp
+// =====================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <termios.h>
+#include <math.h>
+
+#define LINK_SYNC       0xA5    // lib/CommandLink frame start
+#define LINK_MAX_PAYLOAD 16
+#define LINE_MAX_CHARS  256
+#define TIME_UNITS_PER_S 10000000ULL    // 7 decimals in the log
+#define HIST_SUB_BITS   7
+#define HIST_SUB        (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS    ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+// --------------------- Statistics ----------------------
+
+// Running count, mean, variance (Welford) and extremes, plus a histogram
+// of the deviation from the first sample: log-linear in both directions,
+// so the percentiles are as fine as the spread of the values, not their
+// size (a 350 ms duration still resolves to 0.1 us). Values in 0.1 us
+struct Stats {
+    uint64_t n;
+    double mean, m2;
+    int64_t min, max, reference;
+    uint64_t above[HIST_BUCKETS], below[HIST_BUCKETS];
+
+    static int index(uint64_t v) {
+        if (v < 2 * HIST_SUB) return (int)v;
+        int shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+        return (shift + 1) * HIST_SUB + (int)((v >> shift) - HIST_SUB);
+    }
+
+    // Middle of a bucket
+    static double value(int i) {
+        if (i < 2 * HIST_SUB) return i;
+        int shift = i / HIST_SUB - 1;
+        uint64_t low = (uint64_t)(i % HIST_SUB + HIST_SUB) << shift;
+        return low + ((1ULL << shift) - 1) / 2.0;
+    }
+
+    void add(int64_t v) {
+        if (!n) reference = min = max = v;
+        n++;
+        double d = v - mean;
+        mean += d / n;
+        m2 += d * (v - mean);
+        if (v < min) min = v;
+        if (v > max) max = v;
+        if (v >= reference) above[index(v - reference)]++;
+        else below[index(reference - v)]++;
+    }
+
+    double percentile(double p) const {
+        uint64_t rank = (uint64_t)ceil(p * n), seen = 0;     // nearest rank
+        if (!rank) rank = 1;
+        double v = max;
+        for (int i = HIST_BUCKETS - 1; i >= 0 && seen < rank; i--) {
+            seen += below[i];
+            v = reference - value(i);
+        }
+        for (int i = 0; i < HIST_BUCKETS && seen < rank; i++) {
+            seen += above[i];
+            v = reference + value(i);
+        }
+        return v < min ? min : v > max ? max : v;
+    }
+
+    // One summary line; values scaled by 'scale' (0.1 us units per unit)
+    // and shifted by 'offset' (for errors against a nominal value)
+    void print(const char *name, double scale, double offset,
+               const char *unit) const {
+        if (!n) {
+            printf("%-10s no samples\n", name);
+            return;
+        }
+        printf("%-10s n=%-8llu min %9.1f  mean %9.1f  p50 %9.1f  p99 %9.1f"
+               "  max %9.1f  sd %7.1f %s\n", name, (unsigned long long)n,
+               min / scale - offset, mean / scale - offset,
+               percentile(0.5) / scale - offset,
+               percentile(0.99) / scale - offset, max / scale - offset,
+               n > 1 ? sqrt(m2 / (n - 1)) / scale : 0.0, unit);
+    }
+};
+
+// --------------------- Trials ----------------------
+
+struct Trial {
+    uint32_t tone;
+    bool done;                          // counted; later lines are reports
+    bool triggered, started, ended, restarted;
+    uint64_t triggerTime;               // 0.1 us since boot
+    uint64_t onset;                     // 0.1 us
+    uint32_t hz;
+    uint32_t durationUs;
+    int64_t itiUnits;                   // -1 = first trial of a boot
+};
+
+struct Session {
+    Trial trial;                        // the latest tone number seen
+    uint64_t lastTime, lastTrigger;
+    bool haveTrigger;
+
+    uint64_t lines, events, frames, malformed;
+    uint64_t trials, complete, restarted, incomplete, missing, reboots;
+    uint64_t dropped, coalesced, overruns;
+    uint16_t droppedTotal, coalescedTotal;  // last "(N total)" this boot
+
+    Stats onset, duration, iti;
+};
+
+static Session s;
+static FILE *csv;
+static const char *source = "-";
+static double nominalUs = 350000;
+static uint64_t every;
+static volatile sig_atomic_t stop;
+
+static void printSummary() {
+    printf("# %s: %llu lines, %llu events, %llu binary frames, "
+           "%llu malformed\n", source, (unsigned long long)s.lines,
+           (unsigned long long)s.events, (unsigned long long)s.frames,
+           (unsigned long long)s.malformed);
+    printf("# trials: %llu (%llu complete, %llu restarted, %llu incomplete, "
+           "%llu lost to log overruns), %llu reboot(s)\n",
+           (unsigned long long)s.trials, (unsigned long long)s.complete,
+           (unsigned long long)s.restarted, (unsigned long long)s.incomplete,
+           (unsigned long long)s.missing, (unsigned long long)s.reboots);
+    printf("# triggers: %llu dropped, %llu coalesced; log overruns: %llu "
+           "event(s)\n", (unsigned long long)s.dropped,
+           (unsigned long long)s.coalesced, (unsigned long long)s.overruns);
+    s.onset.print("onset", 10, 0, "us");
+    s.duration.print("duration", 10, 0, "us");
+    s.duration.print("dur error", 10, nominalUs, "us");
+    s.iti.print("iti", 10000, 0, "ms");
+    fflush(stdout);
+}
+
+// Count the trial once: at its END or RESTART, or when the next tone
+// number shows up without either
+static void finishTrial() {
+    Trial &t = s.trial;
+    if (t.done) return;
+    t.done = true;
+    if (!t.triggered && !t.started) return;     // Drop reports only
+
+    s.trials++;
+    const char *status = "ok";
+    if (t.ended) {
+        s.complete++;
+        s.duration.add((uint64_t)t.durationUs * 10);
+    } else if (t.restarted) {
+        s.restarted++;
+        status = "restart";
+    } else {
+        s.incomplete++;
+        status = "incomplete";
+    }
+
+    if (csv) {
+        fprintf(csv, "%u,%s,", t.tone, status);
+        if (t.triggered) {
+            fprintf(csv, "%.7f,%.1f", t.triggerTime / (double)TIME_UNITS_PER_S,
+                    t.onset / 10.0);
+        } else {
+            fprintf(csv, ",");
+        }
+        fprintf(csv, ",%u,", t.hz);
+        if (t.ended) fprintf(csv, "%u,%.0f", t.durationUs, t.durationUs - nominalUs);
+        else fprintf(csv, ",");
+        if (t.itiUnits >= 0) fprintf(csv, ",%.4f\n", t.itiUnits / 10000.0);
+        else fprintf(csv, ",\n");
+    }
+    if (every && s.trials % every == 0) printSummary();
+}
+
+static void newTrial(uint32_t tone) {
+    memset(&s.trial, 0, sizeof(s.trial));
+    s.trial.tone = tone;
+    s.trial.itiUnits = -1;
+}
+
+// "[S.FFFFFFF s] Tone #N EVENT ..." -> time in 0.1 us, tone and the rest
+static bool parseEvent(const char *line, uint64_t &time, uint32_t &tone,
+                       const char *&rest) {
+    char *end;
+    if (line[0] != '[') return false;
+    unsigned long long seconds = strtoull(line + 1, &end, 10);
+    if (*end != '.') return false;
+    const char *frac = end + 1;
+    unsigned long long units = strtoull(frac, &end, 10);
+    if (end - frac != 7 || strncmp(end, " s] Tone #", 10)) return false;
+    time = seconds * TIME_UNITS_PER_S + units;
+    tone = strtoul(end + 10, &end, 10);
+    rest = end;
+    return true;
+}
+
+static void processLine(const char *line) {
+    s.lines++;
+    if (!strncmp(line, "[LOG] ", 6)) {
+        s.overruns += strtoull(line + 6, NULL, 10);
+        return;
+    }
+
+    uint64_t time;
+    uint32_t tone;
+    const char *rest;
+    if (!parseEvent(line, time, tone, rest)) {
+        if (line[0] == '[' && strstr(line, " s] Tone #")) s.malformed++;
+        return;                 // Banner and status text
+    }
+    s.events++;
+
+    // A new boot of the firmware: time and tone numbers start over
+    if (time < s.lastTime || tone < s.trial.tone) {
+        finishTrial();
+        newTrial(0);
+        s.trial.done = true;
+        s.haveTrigger = false;
+        s.droppedTotal = s.coalescedTotal = 0;
+        s.reboots++;
+    }
+    s.lastTime = time;
+
+    // Every record of a trial carries its tone number; numbers skipped
+    // are trials whose records were all lost
+    if (tone != s.trial.tone) {
+        finishTrial();
+        s.missing += tone - s.trial.tone - 1;
+        newTrial(tone);
+    }
+    Trial &t = s.trial;
+
+    double value;
+    unsigned long count;
+    if (sscanf(rest, " TRIGGER (onset +%lf us)", &value) == 1) {
+        t.triggered = true;
+        t.triggerTime = time;
+        t.onset = (uint64_t)(value * 10 + 0.5);
+        s.onset.add(t.onset);
+        if (s.haveTrigger) {
+            t.itiUnits = time - s.lastTrigger;
+            s.iti.add(time - s.lastTrigger);
+        }
+        s.lastTrigger = time;
+        s.haveTrigger = true;
+    } else if (sscanf(rest, " START (%lu Hz)", &count) == 1) {
+        t.started = true;
+        t.hz = count;
+    } else if (sscanf(rest, " END (duration: %lu us)", &count) == 1) {
+        t.ended = true;
+        t.durationUs = count;
+        finishTrial();
+    } else if (sscanf(rest, " TRIGGER DROPPED (%lu total)", &count) == 1) {
+        s.dropped += (uint16_t)(count - s.droppedTotal);
+        s.droppedTotal = count;
+    } else if (sscanf(rest, " TRIGGER COALESCED (%lu total)", &count) == 1) {
+        s.coalesced += (uint16_t)(count - s.coalescedTotal);
+        s.coalescedTotal = count;
+    } else if (!strncmp(rest, " RESTART", 8)) {
+        t.restarted = true;
+        finishTrial();
+    } else if (strncmp(rest, " SEQUENCE (", 11) && strncmp(rest, " RAMP ", 6)) {
+        s.malformed++;
+    }
+}
+
+// --------------------- Input ----------------------
+
+static void onSignal(int) { stop = 1; }
+
+// Raw 8N1 at the given speed, so replies pass through unchanged
+static bool setupTty(int fd, int baud) {
+    struct termios tio;
+    if (tcgetattr(fd, &tio)) return false;
+    cfmakeraw(&tio);
+    speed_t speed = baud == 9600 ? B9600 : baud == 57600 ? B57600 :
+                    baud == 230400 ? B230400 : B115200;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+int main(int argc, char **argv) {
+    const char *csvPath = NULL;
+    int baud = 115200;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--duration-ms") && i + 1 < argc) nominalUs = atof(argv[++i]) * 1000;
+        else if (!strcmp(argv[i], "--csv") && i + 1 < argc) csvPath = argv[++i];
+        else if (!strcmp(argv[i], "--every") && i + 1 < argc) every = strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--baud") && i + 1 < argc) baud = atoi(argv[++i]);
+        else if (argv[i][0] == '-' && argv[i][1]) {
+            fprintf(stderr, "usage: %s [FILE|DEVICE|-] [--duration-ms MS] "
+                    "[--csv FILE] [--every N] [--baud B]\n", argv[0]);
+            return 2;
+        }
+        else source = argv[i];
+    }
+
+    int fd = 0;
+    if (strcmp(source, "-")) {
+        fd = open(source, O_RDONLY | O_NOCTTY);
+        if (fd < 0) {
+            perror(source);
+            return 2;
+        }
+    }
+    if (isatty(fd) && !setupTty(fd, baud)) {
+        perror(source);
+        return 2;
+    }
+    s.trial.done = true;        // Nothing counted before the first line
+    if (csvPath) {
+        csv = fopen(csvPath, "w");
+        if (!csv) {
+            perror(csvPath);
+            return 2;
+        }
+        fprintf(csv, "tone,status,trigger_s,onset_us,hz,duration_us,"
+                "duration_error_us,iti_ms\n");
+    }
+
+    // No SA_RESTART: Ctrl-C interrupts a blocking read on a quiet port
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // Text lines with binary frames skipped wherever they fall, also in
+    // the middle of a line
+    char line[LINE_MAX_CHARS];
+    size_t length = 0;
+    bool overlong = false;
+    int frameSkip = -1;         // -1: text, 0: length byte next, n: bytes left
+    uint8_t buffer[4096];
+
+    while (!stop) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        for (ssize_t i = 0; i < n; i++) {
+            uint8_t b = buffer[i];
+            if (frameSkip == 0) {
+                if (b > LINK_MAX_PAYLOAD) {
+                    s.malformed++;
+                    frameSkip = -1;
+                } else {
+                    frameSkip = b + 2;  // command, payload, CRC
+                }
+                continue;
+            }
+            if (frameSkip > 0) {
+                if (--frameSkip == 0) {
+                    s.frames++;
+                    frameSkip = -1;
+                }
+                continue;
+            }
+            if (b == LINK_SYNC) {
+                frameSkip = 0;
+                continue;
+            }
+
+            if (b == '\n') {
+                if (overlong) s.malformed++;
+                else if (length) {
+                    line[length] = 0;
+                    processLine(line);
+                }
+                length = 0;
+                overlong = false;
+            } else if (b != '\r') {
+                if (length < sizeof(line) - 1) line[length++] = b;
+                else overlong = true;
+            }
+        }
+    }
+
+    finishTrial();
+    printSummary();
+    if (csv) fclose(csv);
+    if (fd) close(fd);
+    return 0;
+}